@@ -0,0 +1,152 @@
+#!/usr/bin/python3
+#
+# bench.py - Measures the simulator's speed on the kernels in code/bench
+# (see scripts/bench_kernels.py) in three modes:
+#
+#   silent  riscv -e               the simulation alone
+#   trace   riscv -e -r -t         with the -r/-t trace printed to /dev/null
+#   disasm  riscv -d               disassembling the kernel repeated to fill
+#                                  DISASM_WORDS words
+#
+# Each run is repeated and the fastest kept. The report, written as JSON,
+# gives the host time, the guest instructions (words for disasm) and MIPS
+# per kernel and mode. The iteration counts are fixed so reports from
+# different commits can be compared with --baseline.
+import argparse
+import json
+import os
+import platform
+import resource
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.abspath(__file__))
+KERNEL_DIR = os.path.join(ROOT, "code", "bench")
+
+# iterations per mode; about 15M instructions silent, 0.5M traced
+KERNELS = {
+    "multiply": {"silent": 200000, "trace": 6000},
+    "mac": {"silent": 1600000, "trace": 50000},
+    "random": {"silent": 1000000, "trace": 30000},
+    "stream": {"silent": 120, "trace": 4},
+    "branch": {"silent": 900000, "trace": 28000},
+}
+MODES = ["silent", "trace", "disasm"]
+DISASM_WORDS = 200000
+# a cached result would time the cache
+ENV = {k: v for k, v in os.environ.items() if k != "RISCV_CACHE"}
+
+def run(command):
+    """Returns the wall and CPU seconds of command and what it printed on
+    stderr."""
+    before = resource.getrusage(resource.RUSAGE_CHILDREN)
+    start = time.perf_counter()
+    result = subprocess.run(command, stdout=subprocess.DEVNULL,
+                            stderr=subprocess.PIPE, universal_newlines=True,
+                            env=ENV)
+    wall = time.perf_counter() - start
+    after = resource.getrusage(resource.RUSAGE_CHILDREN)
+    cpu = (after.ru_utime - before.ru_utime) + (after.ru_stime - before.ru_stime)
+    if result.returncode != 0:
+        sys.exit("%s failed with status %d" % (" ".join(command), result.returncode))
+    return wall, cpu, result.stderr
+
+def disasm_image(kernel, directory):
+    with open(os.path.join(KERNEL_DIR, kernel + ".input")) as f:
+        words = f.read().split()
+    path = os.path.join(directory, kernel + ".input")
+    with open(path, "w") as f:
+        for i in range(DISASM_WORDS):
+            f.write(words[i % len(words)] + "\n")
+    return path
+
+def measure(riscv, kernel, mode, repeat, directory):
+    if mode == "disasm":
+        command = [riscv, "-d", disasm_image(kernel, directory)]
+        instructions = DISASM_WORDS
+    else:
+        command = [riscv, "-e", "--count-instructions",
+                   "-a", "0,%x" % KERNELS[kernel][mode],
+                   os.path.join(KERNEL_DIR, kernel + ".input")]
+        if mode == "trace":
+            command[2:2] = ["-r", "-t"]
+    best = None
+    for _ in range(repeat):
+        wall, cpu, err = run(command)
+        if mode != "disasm":
+            instructions = int(err.split("instructions:")[-1])
+        if best is None or wall < best[0]:
+            best = (wall, cpu)
+    return {"kernel": kernel, "mode": mode, "instructions": instructions,
+            "seconds": round(best[0], 6), "cpu_seconds": round(best[1], 6),
+            "mips": round(instructions / best[0] / 1e6, 3)}
+
+def commit():
+    try:
+        return subprocess.check_output(["git", "-C", ROOT, "rev-parse", "--short", "HEAD"],
+                                       stderr=subprocess.DEVNULL,
+                                       universal_newlines=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+def compare(results, baseline, baseline_file, threshold):
+    """Prints the change in MIPS against an earlier report and returns the
+    number of runs slower by more than threshold."""
+    baseline = {(r["kernel"], r["mode"]): r for r in baseline["results"]}
+    regressions = 0
+    print("\nagainst %s:" % baseline_file)
+    for r in results:
+        old = baseline.get((r["kernel"], r["mode"]))
+        if old is None:
+            continue
+        change = r["mips"] / old["mips"] - 1
+        slower = change < -threshold
+        regressions += slower
+        print("  %-10s %-7s %9.3f -> %9.3f MIPS %+6.1f%%%s" %
+              (r["kernel"], r["mode"], old["mips"], r["mips"], 100 * change,
+               "  REGRESSION" if slower else ""))
+    return regressions
+
+def main():
+    parser = argparse.ArgumentParser(description="Simulator benchmarks")
+    parser.add_argument("--riscv", default=os.path.join(ROOT, "riscv"))
+    parser.add_argument("-o", "--output", default=os.path.join(ROOT, "code", "out", "bench.json"))
+    parser.add_argument("-r", "--repeat", type=int, default=3)
+    parser.add_argument("-k", "--kernel", action="append", choices=sorted(KERNELS))
+    parser.add_argument("-m", "--mode", action="append", choices=MODES)
+    parser.add_argument("-b", "--baseline", help="an earlier report to compare with")
+    parser.add_argument("-t", "--threshold", type=float, default=0.10,
+                        help="slowdown that counts as a regression (default 0.10)")
+    args = parser.parse_args()
+
+    # read first, it may be the report about to be replaced
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+    results = []
+    with tempfile.TemporaryDirectory() as directory:
+        for kernel in args.kernel or KERNELS:
+            for mode in args.mode or MODES:
+                r = measure(args.riscv, kernel, mode, args.repeat, directory)
+                results.append(r)
+                print("%-10s %-7s %11d instructions %8.3f s %9.3f MIPS" %
+                      (kernel, mode, r["instructions"], r["seconds"], r["mips"]))
+                sys.stdout.flush()
+
+    report = {"commit": commit(), "host": platform.node(),
+              "machine": platform.machine(), "repeat": args.repeat,
+              "results": results}
+    os.makedirs(os.path.dirname(os.path.abspath(args.output)), exist_ok=True)
+    with open(args.output, "w") as f:
+        json.dump(report, f, indent=2)
+        f.write("\n")
+
+    if baseline and compare(results, baseline, args.baseline, args.threshold):
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
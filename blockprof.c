@@ -0,0 +1,196 @@
+#include "blockprof.h"
+#include "riscv.h"
+#include "symbols.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* blocks shown with their disassembly, and in all */
+#define SHOWN_BLOCKS 10
+#define LISTED_BLOCKS 50
+#define LISTED_LOOPS 20
+
+typedef struct {
+  Address start, end; /* end is the address of the last instruction */
+  Double entries, instructions;
+} Block;
+
+typedef struct {
+  Address head, tail; /* the backward branch or jump is at tail */
+  Double instructions;
+} Loop;
+
+static Engine *profiled_engine = NULL;
+static const Byte *profiled_memory = NULL;
+static FILE *blockprof_file = NULL;
+
+static Word word_at(Address address) {
+  return load((Byte *)profiled_memory, address, LENGTH_WORD);
+}
+
+static Address block_end(Address start) {
+  Address pc = start;
+
+  while (pc < MEMORY_SPACE - 4 && !engine_ends_block(word_at(pc))) {
+    pc += 4;
+  }
+  return pc;
+}
+
+/* where a block ending in bits at pc goes when the branch is taken; like
+ * part2.c, branches land 4 bytes past their target */
+static Address taken_target(Address pc, Word bits) {
+  Instruction instruction = parse_instruction(bits);
+
+  if (instruction.opcode == 0x6F) {
+    return pc + get_jump_offset(instruction);
+  }
+  return pc + get_branch_offset(instruction) + 4;
+}
+
+static int by_instructions(const void *a, const void *b) {
+  Double x = ((const Block *)a)->instructions,
+         y = ((const Block *)b)->instructions;
+
+  return (x < y) - (x > y);
+}
+
+static int loop_by_instructions(const void *a, const void *b) {
+  Double x = ((const Loop *)a)->instructions,
+         y = ((const Loop *)b)->instructions;
+
+  return (x < y) - (x > y);
+}
+
+static void print_location(Address pc) {
+  Address start;
+  const char *name = symbols_lookup(pc, &start);
+
+  if (name != NULL) {
+    fprintf(blockprof_file, "  %s+0x%x", name, pc - start);
+  }
+}
+
+static void print_disassembly(Address start, Address end) {
+  char line[DISASM_LINE_SIZE];
+  Address pc;
+
+  for (pc = start; pc <= end; pc += 4) {
+    disassemble_instruction(line, word_at(pc));
+    line[strcspn(line, "\n")] = '\0';
+    fprintf(blockprof_file, "        %08x: %s\n", pc, line);
+  }
+}
+
+static void blockprof_close(void) {
+  Block *blocks = NULL;
+  Loop *loops = NULL;
+  int block_count = 0, loop_count = 0, i, j;
+  Double total = 0, cumulative = 0;
+  Address pc;
+
+  for (pc = 0; pc <= MEMORY_SPACE - 4; pc += 4) {
+    Double entries = engine_block_entries(profiled_engine, pc);
+
+    if (entries != 0) {
+      Block block = {pc, block_end(pc), entries, 0};
+
+      block.instructions = entries * ((block.end - pc) / 4 + 1);
+      total += block.instructions;
+      blocks = realloc(blocks, (block_count + 1) * sizeof(Block));
+      blocks[block_count++] = block;
+    }
+  }
+
+  /* a loop's instructions are those of the blocks starting inside it, up
+   * to its backward branch; blocks are still in address order here */
+  for (i = 0; i < block_count; i++) {
+    Word bits = word_at(blocks[i].end);
+    Loop loop = {0, blocks[i].end, 0};
+
+    if ((bits & 0x7F) == 0x73) {
+      continue;
+    }
+    loop.head = taken_target(blocks[i].end, bits);
+    if (loop.head > loop.tail) {
+      continue;
+    }
+    /* blocks entered part way share their ends */
+    for (j = 0; j < loop_count; j++) {
+      if (loops[j].head == loop.head && loops[j].tail == loop.tail) {
+        break;
+      }
+    }
+    if (j < loop_count) {
+      continue;
+    }
+    for (j = 0; j < block_count; j++) {
+      if (blocks[j].start >= loop.head && blocks[j].start <= loop.tail) {
+        Address end = blocks[j].end < loop.tail ? blocks[j].end : loop.tail;
+
+        loop.instructions +=
+            blocks[j].entries * ((end - blocks[j].start) / 4 + 1);
+      }
+    }
+    loops = realloc(loops, (loop_count + 1) * sizeof(Loop));
+    loops[loop_count++] = loop;
+  }
+  qsort(blocks, block_count, sizeof(Block), by_instructions);
+  qsort(loops, loop_count, sizeof(Loop), loop_by_instructions);
+
+  fflush(stdout);
+  fprintf(blockprof_file, "block profile: %llu instructions in %d blocks\n",
+          (unsigned long long)total, block_count);
+  fprintf(blockprof_file, "%14s %7s %7s %12s %5s  %s\n", "instructions", "%",
+          "cum %", "entries", "size", "block");
+  for (i = 0; i < block_count && i < LISTED_BLOCKS; i++) {
+    cumulative += blocks[i].instructions;
+    fprintf(blockprof_file,
+            "%14llu %6.2f%% %6.2f%% %12llu %5u  %08x-%08x",
+            (unsigned long long)blocks[i].instructions,
+            100.0 * blocks[i].instructions / total, 100.0 * cumulative / total,
+            (unsigned long long)blocks[i].entries,
+            (blocks[i].end - blocks[i].start) / 4 + 1, blocks[i].start,
+            blocks[i].end);
+    print_location(blocks[i].start);
+    fprintf(blockprof_file, "\n");
+    if (i < SHOWN_BLOCKS) {
+      print_disassembly(blocks[i].start, blocks[i].end);
+    }
+  }
+  if (block_count > LISTED_BLOCKS) {
+    fprintf(blockprof_file, "  ... %d more blocks\n",
+            block_count - LISTED_BLOCKS);
+  }
+
+  fprintf(blockprof_file, "\nloops: %d\n", loop_count);
+  if (loop_count != 0) {
+    fprintf(blockprof_file, "%14s %7s  %s\n", "instructions", "%", "loop");
+  }
+  for (i = 0; i < loop_count && i < LISTED_LOOPS; i++) {
+    fprintf(blockprof_file, "%14llu %6.2f%%  %08x-%08x",
+            (unsigned long long)loops[i].instructions,
+            100.0 * loops[i].instructions / total, loops[i].head,
+            loops[i].tail);
+    print_location(loops[i].head);
+    fprintf(blockprof_file, "\n");
+  }
+  if (blockprof_file != stderr) {
+    fclose(blockprof_file);
+  }
+  free(blocks);
+  free(loops);
+}
+
+int blockprof_open(const char *filename, Engine *engine, const Byte *memory) {
+  blockprof_file = filename != NULL ? fopen(filename, "w") : stderr;
+  if (blockprof_file == NULL) {
+    return -1;
+  }
+  profiled_engine = engine;
+  profiled_memory = memory;
+  engine_count_blocks(engine);
+  atexit(blockprof_close);
+  return 0;
+}
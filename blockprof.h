@@ -0,0 +1,18 @@
+#ifndef BLOCKPROF_H
+#define BLOCKPROF_H
+
+#include "engine.h"
+#include "types.h"
+
+/* Block profile (--block-profile): the engine counts in its decode table
+   how often each block (straight-line code up to a branch, a jump or a
+   system instruction) starts, which costs a test per instruction. At
+   exit the blocks are printed hottest first, by the instructions executed
+   in them, with their disassembly and function names (see symbols.h),
+   followed by the loops, found from the backward branches and jumps. The
+   blocks are those of the program in memory at exit. */
+
+/* the profile goes to filename, or to stderr if it is NULL */
+int blockprof_open(const char *filename, Engine *engine, const Byte *memory);
+
+#endif
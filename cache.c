@@ -0,0 +1,260 @@
+#define _GNU_SOURCE /* for fopencookie() and on_exit() */
+#include "cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* FNV-1a with 128 bits, so entries can be named by their key alone */
+typedef unsigned __int128 Hash;
+
+#define HASH_BASIS ((Hash)0x6c62272e07bb0142ULL << 64 | 0x62b821756295c58dULL)
+#define HASH_PRIME ((Hash)1 << 88 | 0x13b)
+
+static Hash hash_bytes(Hash hash, const void *data, size_t length) {
+  const Byte *bytes = data;
+  size_t i;
+
+  for (i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * HASH_PRIME;
+  }
+  return hash;
+}
+
+static int hash_file(Hash *hash, const char *filename) {
+  FILE *file = fopen(filename, "rb");
+  Byte buffer[65536];
+  Double total = 0;
+  size_t n;
+
+  if (file == NULL) {
+    return -1;
+  }
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    *hash = hash_bytes(*hash, buffer, n);
+    total += n;
+  }
+  fclose(file);
+  /* so the files' boundaries are part of the key */
+  *hash = hash_bytes(*hash, &total, sizeof(total));
+  return 0;
+}
+
+/* ---- recording ---- */
+
+/* A stream writing both to a file descriptor and to a copy. */
+typedef struct {
+  int fd;
+  FILE *copy;
+} Tee;
+
+static Tee stdout_tee, stderr_tee;
+static char *stderr_copy = NULL;
+static size_t stderr_copy_length;
+static char *entry_name, *temp_name = NULL;
+static const char *cache_dir;
+static int (*still_cacheable)(void);
+
+static ssize_t tee_write(void *cookie, const char *data, size_t size) {
+  Tee *tee = cookie;
+  size_t done = 0;
+
+  while (done < size) {
+    ssize_t n = write(tee->fd, data + done, size - done);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return done > 0 ? (ssize_t)done : -1;
+    }
+    done += n;
+  }
+  if (tee->copy != NULL) {
+    fwrite(data, 1, size, tee->copy);
+  }
+  return size;
+}
+
+static FILE *open_tee(Tee *tee, int fd, FILE *copy, int mode) {
+  cookie_io_functions_t functions = {NULL, tee_write, NULL, NULL};
+  FILE *stream;
+
+  tee->fd = fd;
+  tee->copy = copy;
+  stream = fopencookie(tee, "w", functions);
+  if (stream != NULL) {
+    setvbuf(stream, NULL, mode, BUFSIZ);
+  }
+  return stream;
+}
+
+/* Completes the entry once everything else has been flushed: registered
+ * before the handlers that print at exit, so it runs after them. */
+static void cache_finish(int status, void *arg) {
+  FILE *entry = stdout_tee.copy;
+  CacheHeader header;
+
+  fflush(stdout);
+  fflush(stderr);
+  stdout_tee.copy = NULL;
+  fclose(stderr_tee.copy);
+  stderr_tee.copy = NULL;
+  if (!still_cacheable()) {
+    fclose(entry);
+    if (temp_name != NULL) {
+      unlink(temp_name);
+    }
+    return;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, 4);
+  header.version = CACHE_VERSION;
+  header.status = status;
+  header.stdout_length = ftell(entry) - sizeof(header);
+  header.stderr_length = stderr_copy_length;
+  fwrite(stderr_copy, 1, stderr_copy_length, entry);
+  rewind(entry);
+  fwrite(&header, sizeof(header), 1, entry);
+  if (fflush(entry) == 0) {
+    if (temp_name == NULL) {
+      char link[64];
+
+      /* fails harmlessly if an identical run got there first */
+      snprintf(link, sizeof(link), "/proc/self/fd/%d", fileno(entry));
+      linkat(AT_FDCWD, link, AT_FDCWD, entry_name, AT_SYMLINK_FOLLOW);
+    } else {
+      rename(temp_name, entry_name);
+    }
+  } else if (temp_name != NULL) {
+    unlink(temp_name);
+  }
+  fclose(entry);
+}
+
+/* Creates the file the entry is written to. It has no name until it is
+ * complete where the file system allows, so killed runs leave nothing. */
+static FILE *create_entry(void) {
+  int fd = open(cache_dir, O_TMPFILE | O_RDWR, 0644);
+
+  if (fd >= 0) {
+    return fdopen(fd, "w+b");
+  }
+  temp_name = malloc(strlen(entry_name) + 32);
+  sprintf(temp_name, "%s.%d.tmp", entry_name, (int)getpid());
+  return fopen(temp_name, "w+b");
+}
+
+static void record(void) {
+  FILE *entry, *err_copy, *out, *err;
+  CacheHeader header;
+
+  entry = create_entry();
+  if (entry == NULL) {
+    return;
+  }
+  /* the header is filled in at the end */
+  memset(&header, 0, sizeof(header));
+  fwrite(&header, sizeof(header), 1, entry);
+  err_copy = open_memstream(&stderr_copy, &stderr_copy_length);
+  out = open_tee(&stdout_tee, STDOUT_FILENO, entry,
+                 isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF);
+  err = open_tee(&stderr_tee, STDERR_FILENO, err_copy, _IONBF);
+  if (err_copy == NULL || out == NULL || err == NULL) {
+    fclose(entry);
+    if (temp_name != NULL) {
+      unlink(temp_name);
+    }
+    return;
+  }
+  stdout = out;
+  stderr = err;
+  on_exit(cache_finish, NULL);
+}
+
+/* ---- replaying ---- */
+
+static int copy_out(FILE *from, Double length, FILE *to) {
+  char buffer[65536];
+
+  while (length > 0) {
+    size_t n = fread(buffer, 1,
+                     length < sizeof(buffer) ? length : sizeof(buffer), from);
+
+    if (n == 0) {
+      return -1;
+    }
+    fwrite(buffer, 1, n, to);
+    length -= n;
+  }
+  return 0;
+}
+
+static int replay(FILE *entry, int *status) {
+  CacheHeader header;
+
+  if (fread(&header, sizeof(header), 1, entry) != 1 ||
+      memcmp(header.magic, CACHE_MAGIC, 4) != 0 ||
+      header.version != CACHE_VERSION) {
+    return 0;
+  }
+  /* an entry is complete once renamed, so it can only fail to read if it
+   * was damaged since; by then part of it may have been printed */
+  if (copy_out(entry, header.stdout_length, stdout) != 0 ||
+      copy_out(entry, header.stderr_length, stderr) != 0) {
+    fprintf(stderr, "Damaged cache entry %s\n", entry_name);
+    exit(-1);
+  }
+  *status = header.status;
+  return 1;
+}
+
+int cache_begin(const char *dir, int argc, char **argv,
+                const char *const *inputs, int (*cacheable)(void),
+                int *status) {
+  Hash hash = HASH_BASIS;
+  FILE *entry;
+  int i;
+
+  /* the build, the arguments but for the cache's own, and the inputs */
+  if (hash_file(&hash, "/proc/self/exe") != 0) {
+    return 0;
+  }
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--cache=", 8) == 0) {
+      continue;
+    }
+    if (strcmp(argv[i], "--cache") == 0) {
+      i++;
+      continue;
+    }
+    hash = hash_bytes(hash, argv[i], strlen(argv[i]) + 1);
+  }
+  for (i = 0; inputs[i] != NULL; i++) {
+    if (hash_file(&hash, inputs[i]) != 0) {
+      return 0;
+    }
+  }
+
+  mkdir(dir, 0777);
+  cache_dir = dir;
+  entry_name = malloc(strlen(dir) + 34);
+  sprintf(entry_name, "%s/%016llx%016llx", dir,
+          (unsigned long long)(hash >> 64), (unsigned long long)hash);
+  entry = fopen(entry_name, "rb");
+  if (entry != NULL) {
+    int hit = replay(entry, status);
+
+    fclose(entry);
+    if (hit) {
+      return 1;
+    }
+  }
+  still_cacheable = cacheable;
+  record();
+  return 0;
+}
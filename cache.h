@@ -0,0 +1,34 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "types.h"
+
+/* Result cache: a run is fully determined by the simulator build, its
+   arguments and the files it reads, so its output and exit status are
+   stored in a directory under a hash of all of those and replayed by the
+   next identical run instead of simulating again. Entries are a
+   CacheHeader followed by what the run wrote to stdout, then to stderr.
+   A run that is killed (e.g. by timeout) leaves no entry. */
+#define CACHE_MAGIC "RVRC"
+#define CACHE_VERSION 1
+
+typedef struct {
+    char magic[4];
+    Half version;
+    Half reserved;
+    sWord status; /* as passed to exit() */
+    Word reserved2;
+    Double stdout_length;
+    Double stderr_length;
+} CacheHeader;
+
+/* inputs are the files the run reads, NULL-terminated. If dir holds the
+   result of the run, prints it, sets status to its exit status and
+   returns 1. Otherwise starts recording the run's output for an entry
+   written when it exits, if cacheable() then returns nonzero, and
+   returns 0. */
+int cache_begin(const char *dir, int argc, char **argv,
+                const char *const *inputs, int (*cacheable)(void),
+                int *status);
+
+#endif
@@ -0,0 +1,267 @@
+#include "callgraph.h"
+#include "symbols.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_DEPTH 4096
+#define LISTED_FUNCTIONS 20
+
+int callgraph_active = 0;
+
+typedef struct {
+  Address entry;
+  Double exclusive, inclusive, calls;
+  int active; /* frames on the stack, for recursion */
+} Function;
+
+typedef struct {
+  int caller, callee;
+  Address site; /* of the jal */
+  Double calls, inclusive;
+} Edge;
+
+typedef struct {
+  int function, edge;
+  Address return_address;
+  Double start; /* instructions executed before the call returned */
+} Frame;
+
+static Function *functions = NULL;
+static Edge *edges = NULL;
+static int function_count = 0, function_capacity = 0, edge_count = 0,
+           edge_capacity = 0;
+/* by pc / 4: the function entered there and the first edge called from
+ * there, plus one, and the instructions executed there and the function
+ * that first executed them, plus one */
+static int *function_by_entry = NULL, *edge_by_site = NULL, *owner = NULL;
+static Double *self = NULL;
+
+static Frame stack[MAX_DEPTH];
+static int depth = 0;
+static Double executed = 0, lost_calls = 0;
+static FILE *callgraph_file = NULL;
+static const char *callgraph_filename = NULL;
+
+static int function_at(Address entry) {
+  int id = function_by_entry[entry / 4] - 1;
+
+  if (id < 0) {
+    if (function_count == function_capacity) {
+      function_capacity = function_capacity ? 2 * function_capacity : 64;
+      functions = realloc(functions, function_capacity * sizeof(Function));
+    }
+    id = function_count++;
+    memset(&functions[id], 0, sizeof(Function));
+    functions[id].entry = entry;
+    function_by_entry[entry / 4] = id + 1;
+  }
+  return id;
+}
+
+static int edge_from(int caller, Address site, int callee) {
+  int id = edge_by_site[site / 4] - 1;
+
+  /* a site calls one function unless its code changes */
+  if (id >= 0 && (edges[id].caller != caller || edges[id].callee != callee)) {
+    for (id = 0; id < edge_count; id++) {
+      if (edges[id].caller == caller && edges[id].site == site &&
+          edges[id].callee == callee) {
+        break;
+      }
+    }
+    if (id == edge_count) {
+      id = -1;
+    }
+  }
+  if (id < 0) {
+    if (edge_count == edge_capacity) {
+      edge_capacity = edge_capacity ? 2 * edge_capacity : 64;
+      edges = realloc(edges, edge_capacity * sizeof(Edge));
+    }
+    id = edge_count++;
+    edges[id].caller = caller;
+    edges[id].callee = callee;
+    edges[id].site = site;
+    edges[id].calls = edges[id].inclusive = 0;
+    if (edge_by_site[site / 4] == 0) {
+      edge_by_site[site / 4] = id + 1;
+    }
+  }
+  return id;
+}
+
+static void push(int function, int edge, Address return_address) {
+  functions[function].calls++;
+  if (depth == MAX_DEPTH) {
+    lost_calls++;
+    return;
+  }
+  stack[depth].function = function;
+  stack[depth].edge = edge;
+  stack[depth].return_address = return_address;
+  stack[depth++].start = executed;
+  functions[function].active++;
+}
+
+static void pop(void) {
+  Frame *frame = &stack[--depth];
+  Double elapsed = executed - frame->start;
+
+  if (frame->edge >= 0) {
+    edges[frame->edge].inclusive += elapsed;
+  }
+  if (--functions[frame->function].active == 0) {
+    functions[frame->function].inclusive += elapsed;
+  }
+}
+
+void callgraph_begin(Word pc) {
+  int function = stack[depth - 1].function;
+
+  executed++;
+  functions[function].exclusive++;
+  if (pc < MEMORY_SPACE) {
+    self[pc / 4]++;
+    if (owner[pc / 4] == 0) {
+      owner[pc / 4] = function + 1;
+    }
+  }
+}
+
+void callgraph_end(Word pc, Word instruction_bits,
+                   const Processor *processor) {
+  Word next = processor->PC;
+  int level;
+
+  if ((instruction_bits & 0x7F) == 0x6F &&
+      (instruction_bits >> 7 & 0x1F) == 1) {
+    if (next < MEMORY_SPACE && pc < MEMORY_SPACE) {
+      int caller = stack[depth - 1].function, callee = function_at(next),
+          edge = edge_from(caller, pc, callee);
+
+      edges[edge].calls++;
+      push(callee, edge, pc + 4);
+    }
+    return;
+  }
+  if (next == pc + 4) {
+    return;
+  }
+  /* a return, perhaps past functions that never returned themselves;
+   * the bottom frame is the program's */
+  for (level = depth - 1; level > 0; level--) {
+    if (stack[level].return_address == next) {
+      while (depth > level) {
+        pop();
+      }
+      return;
+    }
+  }
+}
+
+static const char *function_name(int id, char *buffer, size_t size) {
+  Address start;
+  const char *name = symbols_lookup(functions[id].entry, &start);
+
+  if (name == NULL) {
+    snprintf(buffer, size, "0x%08x", functions[id].entry);
+  } else if (start == functions[id].entry) {
+    snprintf(buffer, size, "%s", name);
+  } else {
+    snprintf(buffer, size, "%s+0x%x", name, functions[id].entry - start);
+  }
+  return buffer;
+}
+
+static int by_inclusive(const void *a, const void *b) {
+  Double x = functions[*(const int *)a].inclusive,
+         y = functions[*(const int *)b].inclusive;
+
+  return (x < y) - (x > y);
+}
+
+static void write_callgrind(void) {
+  char name[96];
+  Address pc;
+  int f, e;
+
+  fprintf(callgraph_file, "# callgrind format\nversion: 1\n"
+                          "creator: riscv --callgraph\npositions: instr\n"
+                          "events: Ir\nsummary: %llu\n",
+          (unsigned long long)executed);
+  for (f = 0; f < function_count; f++) {
+    fprintf(callgraph_file, "\nfn=%s\n", function_name(f, name, sizeof(name)));
+    for (pc = 0; pc < MEMORY_SPACE; pc += 4) {
+      if (owner[pc / 4] == f + 1) {
+        fprintf(callgraph_file, "0x%x %llu\n", pc,
+                (unsigned long long)self[pc / 4]);
+      }
+    }
+    for (e = 0; e < edge_count; e++) {
+      if (edges[e].caller == f) {
+        fprintf(callgraph_file, "cfn=%s\ncalls=%llu 0x%x\n0x%x %llu\n",
+                function_name(edges[e].callee, name, sizeof(name)),
+                (unsigned long long)edges[e].calls,
+                functions[edges[e].callee].entry, edges[e].site,
+                (unsigned long long)edges[e].inclusive);
+      }
+    }
+  }
+}
+
+static void callgraph_close(void) {
+  int *order = malloc(function_count * sizeof(int)), i;
+  char name[96];
+
+  callgraph_active = 0;
+  while (depth > 0) {
+    pop();
+  }
+  write_callgrind();
+  fclose(callgraph_file);
+
+  for (i = 0; i < function_count; i++) {
+    order[i] = i;
+  }
+  qsort(order, function_count, sizeof(int), by_inclusive);
+  fflush(stdout);
+  fprintf(stderr, "call graph: %llu instructions in %d functions, in %s\n",
+          (unsigned long long)executed, function_count, callgraph_filename);
+  if (lost_calls != 0) {
+    fprintf(stderr, "  %llu calls deeper than %d frames were not followed\n",
+            (unsigned long long)lost_calls, MAX_DEPTH);
+  }
+  fprintf(stderr, "%14s %7s %14s %7s %10s  %s\n", "inclusive", "%",
+          "exclusive", "%", "calls", "function");
+  for (i = 0; i < function_count && i < LISTED_FUNCTIONS; i++) {
+    const Function *function = &functions[order[i]];
+
+    fprintf(stderr, "%14llu %6.2f%% %14llu %6.2f%% %10llu  %s\n",
+            (unsigned long long)function->inclusive,
+            100.0 * function->inclusive / executed,
+            (unsigned long long)function->exclusive,
+            100.0 * function->exclusive / executed,
+            (unsigned long long)function->calls,
+            function_name(order[i], name, sizeof(name)));
+  }
+  free(order);
+}
+
+int callgraph_open(const char *filename, const Processor *processor) {
+  function_by_entry = calloc(MEMORY_SPACE / 4, sizeof(int));
+  edge_by_site = calloc(MEMORY_SPACE / 4, sizeof(int));
+  owner = calloc(MEMORY_SPACE / 4, sizeof(int));
+  self = calloc(MEMORY_SPACE / 4, sizeof(Double));
+  callgraph_file = fopen(filename, "w");
+  if (function_by_entry == NULL || edge_by_site == NULL || owner == NULL ||
+      self == NULL || callgraph_file == NULL || processor->PC >= MEMORY_SPACE) {
+    return -1;
+  }
+  callgraph_filename = filename;
+  /* the program's frame, which nothing returns from */
+  push(function_at(processor->PC), -1, ~0U);
+  callgraph_active = 1;
+  atexit(callgraph_close);
+  return 0;
+}
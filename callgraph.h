@@ -0,0 +1,23 @@
+#ifndef CALLGRAPH_H
+#define CALLGRAPH_H
+
+#include "types.h"
+
+/* Call-graph profile (--callgraph): a jal with rd = x1 calls the function
+   at its target, and reaching the link address of a call on the shadow
+   stack returns from it and anything it called (the ISA here has no jalr,
+   so returns are the jumps that land there). Every instruction counts
+   for the function it ran in, exclusively, and for the calls in
+   progress, inclusively. At exit the profile is written in callgrind's
+   format, for callgrind_annotate and KCachegrind, and the functions are
+   summarised on stderr. Functions are named by their entry address, or
+   by symbol (see symbols.h). */
+
+/* set while profiling, see execute() in riscv.c */
+extern int callgraph_active;
+
+int callgraph_open(const char *filename, const Processor *processor);
+void callgraph_begin(Word pc);
+void callgraph_end(Word pc, Word instruction_bits, const Processor *processor);
+
+#endif
@@ -0,0 +1,309 @@
+#include "check.h"
+#include "riscv.h"
+#include "trace.h"
+#include "tracestream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int check_active = 0;
+
+/* what the reference says about one instruction */
+typedef struct {
+  int has_pc;        /* -t traces and the compact formats */
+  int has_registers; /* 0 if the simulation ended in this instruction */
+  Word pc;
+  Register R[32];
+} Expected;
+
+enum { REFERENCE_TEXT, REFERENCE_DELTA, REFERENCE_BINARY };
+
+static FILE *reference = NULL;
+static const char *reference_name;
+static int reference_format;
+static Register reference_R[32]; /* delta and binary references */
+
+static char *line = NULL;
+static size_t line_size = 0;
+static int line_pending = 0; /* line was read ahead */
+
+static Double checked = 0;
+static int in_flight = 0;
+static Word flight_pc, flight_bits;
+
+static int read_line(void) {
+  if (line_pending) {
+    line_pending = 0;
+    return 1;
+  }
+  return getline(&line, &line_size, reference) > 0;
+}
+
+/* "0000100c: ..." */
+static int is_pc_line(const char *text, Word *pc) {
+  char *end;
+  unsigned long value = strtoul(text, &end, 16);
+
+  if (end - text != 8 || *end != ':') {
+    return 0;
+  }
+  *pc = value;
+  return 1;
+}
+
+/* Reads the dump starting at first, in line. Console output does not
+ * have to end in a newline, so the dump may start in the middle of it. */
+static int read_dump(const char *first, Register *R) {
+  int i;
+
+  if (parse_register_line(first, R) != 0) {
+    return -1;
+  }
+  for (i = 1; i < 8; i++) {
+    if (!read_line() || parse_register_line(line, R) != 0) {
+      return -1;
+    }
+  }
+  /* and the blank line after it */
+  if (read_line() && line[0] != '\n') {
+    line_pending = 1;
+  }
+  return 0;
+}
+
+/* The pc line of an instruction is followed by its console output and its
+ * dump; both the pc line (-r only) and the dump (the last instruction) may
+ * be missing. */
+static int next_text(Expected *expected) {
+  Word pc;
+  char *dump;
+
+  while (read_line()) {
+    if (is_pc_line(line, &pc)) {
+      if (expected->has_pc) {
+        line_pending = 1;
+        return 1;
+      }
+      expected->has_pc = 1;
+      expected->pc = pc;
+    } else if ((dump = strstr(line, "r 0=")) != NULL) {
+      expected->has_registers = read_dump(dump, expected->R) == 0;
+      return 1;
+    }
+  }
+  return expected->has_pc;
+}
+
+/* see write_delta_line() in trace.c */
+static int next_delta(Expected *expected) {
+  char *item, *end;
+
+  while (read_line()) {
+    int sync = strncmp(line, "sync", 4) == 0;
+
+    if (sync) {
+      item = line + 4;
+    } else if (is_pc_line(line, &expected->pc)) {
+      expected->has_pc = 1;
+      expected->has_registers = 1;
+      item = strstr(line, "  ");
+    } else {
+      continue;
+    }
+
+    for (; item != NULL && strncmp(item, "  ", 2) == 0; item = end) {
+      item += 2;
+      if (item[0] == 'x') {
+        long rd = strtol(item + 1, &end, 10);
+
+        if (rd > 0 && rd < 32) {
+          reference_R[rd] = strtoul(end + 1, &end, 16);
+        }
+      } else if (strncmp(item, "halt", 4) == 0) {
+        expected->has_registers = 0;
+        end = item + 4;
+      } else if (strncmp(item, "mem[", 4) == 0) {
+        end = item + strcspn(item, " \n");
+      } else {
+        break;
+      }
+    }
+    if (!sync) {
+      memcpy(expected->R, reference_R, sizeof(expected->R));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int next_binary(Expected *expected) {
+  TraceRecord record;
+
+  while (fread(&record, sizeof(record), 1, reference) == 1) {
+    if (record.flags & TRACE_OUTPUT) {
+      continue;
+    }
+    if (record.flags & TRACE_REG_WRITE) {
+      reference_R[record.rd] = record.rd_value;
+    }
+    reference_R[0] = 0;
+    if (record.flags & TRACE_SYNC) {
+      continue;
+    }
+    expected->has_pc = expected->has_registers = 1;
+    expected->pc = record.pc;
+    memcpy(expected->R, reference_R, sizeof(expected->R));
+    return 1;
+  }
+  return 0;
+}
+
+static int next_expected(Expected *expected) {
+  memset(expected, 0, sizeof(*expected));
+  switch (reference_format) {
+  case REFERENCE_DELTA:
+    return next_delta(expected);
+  case REFERENCE_BINARY:
+    return next_binary(expected);
+  default:
+    return next_text(expected);
+  }
+}
+
+/* stops the simulation after a mismatch has been reported */
+static void fail(void) {
+  exit(1);
+}
+
+static void mismatch_header(void) {
+  int length;
+  const char *text = disassembly_line(flight_pc, flight_bits, &length);
+
+  fflush(stdout);
+  fprintf(stderr, "check: instruction %llu does not match %s\n  %.*s",
+          (unsigned long long)checked, reference_name, length, text);
+}
+
+/* Compares the simulator's registers after the instruction at the end of
+ * the simulation, when the reference must end too. Returns the status to
+ * exit with: 1 if they differ, status otherwise. */
+int check_close(int status) {
+  Expected expected;
+
+  if (in_flight) {
+    /* the reference may or may not have the instruction that ended it */
+    if (next_expected(&expected) &&
+        (expected.has_registers ||
+         (expected.has_pc && expected.pc != flight_pc) ||
+         next_expected(&expected))) {
+      mismatch_header();
+      fprintf(stderr, "  the simulation ended here, the reference goes on\n");
+      return 1;
+    }
+  } else if (next_expected(&expected)) {
+    fflush(stdout);
+    fprintf(stderr,
+            "check: the simulation ended after %llu instructions, %s goes "
+            "on\n",
+            (unsigned long long)checked, reference_name);
+    return 1;
+  }
+  fprintf(stderr, "check: %llu instructions match %s\n",
+          (unsigned long long)checked, reference_name);
+  return status;
+}
+
+int check_open(const char *filename, const Processor *processor) {
+  TraceHeader header;
+  int i;
+
+  reference = trace_stream_open_read(filename);
+  if (reference == NULL) {
+    return -1;
+  }
+  reference_name = filename;
+
+  /* binary traces start with TRACE_MAGIC, delta traces with the initial
+   * dump followed by pc or sync lines, text traces with a pc line or, if
+   * printed with -r alone, with a dump followed by anything else */
+  if (fread(&header, sizeof(header), 1, reference) == 1 &&
+      memcmp(header.magic, TRACE_MAGIC, 4) == 0) {
+    if (header.version != TRACE_VERSION ||
+        header.record_size != sizeof(TraceRecord)) {
+      return -1;
+    }
+    reference_format = REFERENCE_BINARY;
+    memcpy(reference_R, header.R, sizeof(reference_R));
+  } else {
+    rewind(reference);
+    reference_format = REFERENCE_TEXT;
+    if (read_line() && strncmp(line, "r 0=", 4) == 0 &&
+        read_dump(line, reference_R) == 0 && read_line() &&
+        (is_pc_line(line, &header.PC) || strncmp(line, "sync", 4) == 0)) {
+      reference_format = REFERENCE_DELTA;
+    }
+    rewind(reference);
+    line_pending = 0;
+    if (reference_format == REFERENCE_DELTA) {
+      read_line();
+      read_dump(line, reference_R);
+    }
+  }
+
+  if (reference_format != REFERENCE_TEXT) {
+    for (i = 0; i < 32; i++) {
+      if (reference_R[i] != processor->R[i]) {
+        fprintf(stderr,
+                "check: %s starts with x%d=%08x, the simulator with "
+                "%08x\n",
+                filename, i, reference_R[i], processor->R[i]);
+        return -1;
+      }
+    }
+  }
+
+  check_active = 1;
+  return 0;
+}
+
+void check_begin(Word pc, Word instruction_bits) {
+  flight_pc = pc;
+  flight_bits = instruction_bits;
+  in_flight = 1;
+}
+
+void check_end(const Processor *processor) {
+  Expected expected;
+  int i, differ = 0;
+
+  in_flight = 0;
+  if (!next_expected(&expected)) {
+    mismatch_header();
+    fprintf(stderr, "  the reference ends before it\n");
+    fail();
+  }
+  if (expected.has_pc && expected.pc != flight_pc) {
+    mismatch_header();
+    fprintf(stderr, "  pc: expected %08x, got %08x\n", expected.pc,
+            flight_pc);
+    fail();
+  }
+  if (!expected.has_registers) {
+    mismatch_header();
+    fprintf(stderr, "  the reference ends in it, the simulation goes on\n");
+    fail();
+  }
+  for (i = 0; i < 32; i++) {
+    if (expected.R[i] != processor->R[i]) {
+      if (!differ++) {
+        mismatch_header();
+      }
+      fprintf(stderr, "  x%d: expected %08x, got %08x\n", i, expected.R[i],
+              processor->R[i]);
+    }
+  }
+  if (differ) {
+    fail();
+  }
+  checked++;
+}
@@ -0,0 +1,21 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include "types.h"
+
+/* Lockstep checking: the simulator reads a reference trace while it runs
+   and stops at the first instruction whose pc or registers differ from it.
+   The reference can be a text trace printed by `riscv -r -t` (or just -r),
+   or a binary or delta trace, compressed or not. */
+
+/* set while checking, see execute() in riscv.c */
+extern int check_active;
+
+int check_open(const char *filename, const Processor *processor);
+void check_begin(Word pc, Word instruction_bits);
+void check_end(const Processor *processor);
+/* Checks that the reference ends where the simulation does. Returns the
+   status to exit with: 1 if it does not, status if it does. */
+int check_close(int status);
+
+#endif
@@ -0,0 +1,530 @@
+#define _GNU_SOURCE /* for memmem() */
+#include "compare.h"
+#include "tracestream.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Plain files are mapped and compressed traces (see tracestream.h) are
+ * decompressed a chunk at a time, so memory use does not grow with the
+ * length of the traces. */
+
+#define SOURCE_CHUNK (1 << 20)
+#define CONTEXT_LINES 3
+
+typedef struct {
+  const char *name;
+  FILE *stream;   /* NULL when the file is mapped */
+  char *buffer;   /* a window of the stream */
+  const char *data;
+  size_t length, pos;
+  Double offset;  /* of data[0] in the file */
+} Source;
+
+static int source_open(Source *source, const char *name) {
+  char magic[4];
+  struct stat st;
+  int fd;
+
+  memset(source, 0, sizeof(*source));
+  source->name = name;
+
+  fd = open(name, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    return -1;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    /* a pipe is read as it comes; the report cannot show its context */
+    source->stream = fdopen(fd, "r");
+  } else if (pread(fd, magic, 4, 0) == 4 &&
+             memcmp(magic, TRACE_STREAM_MAGIC, 4) == 0) {
+    close(fd);
+    source->stream = trace_stream_open_read(name);
+    if (source->stream == NULL) {
+      return -1;
+    }
+  }
+  if (source->stream != NULL) {
+    source->buffer = malloc(SOURCE_CHUNK);
+    source->data = source->buffer;
+    return source->buffer != NULL ? 0 : -1;
+  }
+
+  source->data = "";
+  if (st.st_size > 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (map == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    source->data = map;
+    source->length = st.st_size;
+  }
+  close(fd);
+  return 0;
+}
+
+static void source_close(Source *source) {
+  if (source->stream != NULL) {
+    fclose(source->stream);
+    free(source->buffer);
+  } else if (source->length > 0) {
+    munmap((void *)source->data, source->length);
+  }
+}
+
+/* Reads more of a stream, dropping everything before keep. Returns the
+ * number of bytes added, 0 at the end of the file. */
+static size_t source_fill(Source *source, size_t keep) {
+  size_t n;
+
+  if (source->stream == NULL) {
+    return 0;
+  }
+  memmove(source->buffer, source->buffer + keep, source->length - keep);
+  source->offset += keep;
+  source->length -= keep;
+  source->pos -= keep;
+  n = fread(source->buffer + source->length, 1,
+            SOURCE_CHUNK - source->length, source->stream);
+  source->length += n;
+  return n;
+}
+
+/* Sets line/length to the next line, including its newline. Returns 0 at
+ * the end of the file. */
+static int source_line(Source *source, const char **line, size_t *length) {
+  const char *end;
+
+  for (;;) {
+    end = memchr(source->data + source->pos, '\n',
+                 source->length - source->pos);
+    if (end != NULL) {
+      end++;
+      break;
+    }
+    if (source->pos == 0 && source->length == SOURCE_CHUNK) {
+      /* a line longer than the window is taken in pieces */
+      end = source->data + source->length;
+      break;
+    }
+    if (source_fill(source, source->pos) == 0) {
+      end = source->data + source->length;
+      break;
+    }
+  }
+  *line = source->data + source->pos;
+  *length = end - *line;
+  source->pos += *length;
+  return *length > 0;
+}
+
+/* ---- compare.py ---- */
+
+/* what Python's \s matches in ASCII */
+static int is_space(unsigned char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r') || (c >= 0x1c && c <= 0x1f);
+}
+
+/* Returns the next character that is not whitespace, or -1 at the end,
+ * leaving source->pos on it. */
+static int peek_char(Source *source) {
+  for (;;) {
+    while (source->pos < source->length) {
+      unsigned char c = source->data[source->pos];
+
+      if (!is_space(c)) {
+        return c;
+      }
+      source->pos++;
+    }
+    if (source_fill(source, source->pos) == 0) {
+      return -1;
+    }
+  }
+}
+
+/* Returns 0 if a and b only differ in whitespace, otherwise leaves both
+ * on the first character that differs. Identical stretches, the common
+ * case, are skipped 16 bytes at a time. */
+static int compare_text(Source *a, Source *b) {
+  for (;;) {
+#ifdef __SSE2__
+    while (a->pos + 16 <= a->length && b->pos + 16 <= b->length) {
+      __m128i x = _mm_loadu_si128((const __m128i *)(a->data + a->pos));
+      __m128i y = _mm_loadu_si128((const __m128i *)(b->data + b->pos));
+      unsigned same = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+
+      if (same != 0xFFFF) {
+        int n = __builtin_ctz(~same);
+
+        a->pos += n;
+        b->pos += n;
+        break;
+      }
+      a->pos += 16;
+      b->pos += 16;
+    }
+#else
+    while (a->pos < a->length && b->pos < b->length &&
+           a->data[a->pos] == b->data[b->pos]) {
+      a->pos++;
+      b->pos++;
+    }
+#endif
+    int ca = peek_char(a), cb = peek_char(b);
+
+    if (ca != cb) {
+      return 1;
+    }
+    if (ca < 0) {
+      return 0;
+    }
+    a->pos++;
+    b->pos++;
+  }
+}
+
+/* ---- reporting ---- */
+
+/* where a byte offset falls in a trace */
+typedef struct {
+  Double line_number;
+  Double instruction; /* counting from 0 */
+  int have_instruction;
+  int have_pc;
+  unsigned pc;
+  char *line;
+  char *context[CONTEXT_LINES]; /* the lines before, oldest first */
+  int context_lines;
+} Location;
+
+/* "0000100c: ..." */
+static int is_pc_line(const char *line, unsigned *pc) {
+  char *end;
+  unsigned long value = strtoul(line, &end, 16);
+
+  if (end - line != 8 || *end != ':') {
+    return 0;
+  }
+  *pc = value;
+  return 1;
+}
+
+/* Finds the line of name holding byte offset. */
+static void locate(const char *name, Double offset, Location *location) {
+  FILE *file = trace_stream_open_read(name);
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t length;
+  Double at = 0, pc_lines = 0, dumps = 0;
+
+  memset(location, 0, sizeof(*location));
+  if (file == NULL) {
+    return;
+  }
+  while ((length = getline(&line, &size, file)) > 0) {
+    location->line_number++;
+    if (is_pc_line(line, &location->pc)) {
+      location->have_pc = 1;
+      pc_lines++;
+    } else if (strncmp(line, "r 0=", 4) == 0) {
+      dumps++;
+    }
+    if (offset < at + length) {
+      location->line = strdup(line);
+      break;
+    }
+    at += length;
+
+    if (location->context_lines == CONTEXT_LINES) {
+      free(location->context[0]);
+      memmove(location->context, location->context + 1,
+              (CONTEXT_LINES - 1) * sizeof(char *));
+      location->context_lines--;
+    }
+    location->context[location->context_lines++] = strdup(line);
+  }
+  if (pc_lines > 0 || dumps > 0) {
+    location->have_instruction = 1;
+    location->instruction = (pc_lines > 0 ? pc_lines : dumps) - 1;
+  }
+  free(line);
+  fclose(file);
+}
+
+static void print_location(const char *name, const Location *location,
+                           FILE *out) {
+  int i;
+
+  fprintf(out, "%s line %llu:\n", name,
+          (unsigned long long)location->line_number);
+  for (i = 0; i < location->context_lines; i++) {
+    fprintf(out, "    %s", location->context[i]);
+  }
+  if (location->line != NULL) {
+    fprintf(out, "  > %s", location->line);
+    if (location->line[strlen(location->line) - 1] != '\n') {
+      fputc('\n', out);
+    }
+  } else {
+    fprintf(out, "  > (end of file)\n");
+  }
+}
+
+static void free_location(Location *location) {
+  int i;
+
+  for (i = 0; i < location->context_lines; i++) {
+    free(location->context[i]);
+  }
+  free(location->line);
+}
+
+/* Finds the first "rN=value" that differs between two dump lines. */
+static int differing_register(const char *actual, const char *expected,
+                              int *reg, unsigned long *actual_value,
+                              unsigned long *expected_value) {
+  while ((actual = strchr(actual, 'r')) != NULL &&
+         (expected = strchr(expected, 'r')) != NULL) {
+    char *a_end, *e_end;
+    long a_reg = strtol(actual + 1, &a_end, 10);
+    long e_reg = strtol(expected + 1, &e_end, 10);
+
+    if (*a_end != '=' || *e_end != '=' || a_reg != e_reg) {
+      return 0;
+    }
+    *actual_value = strtoul(a_end + 1, &a_end, 16);
+    *expected_value = strtoul(e_end + 1, &e_end, 16);
+    if (*actual_value != *expected_value) {
+      *reg = a_reg;
+      return 1;
+    }
+    actual = a_end;
+    expected = e_end;
+  }
+  return 0;
+}
+
+static void report_text(Source *actual, Source *expected, FILE *out) {
+  Location a, e;
+  int reg;
+  unsigned long a_value, e_value;
+
+  locate(actual->name, actual->offset + actual->pos, &a);
+  locate(expected->name, expected->offset + expected->pos, &e);
+
+  fprintf(out, "%s and %s differ", actual->name, expected->name);
+  if (e.have_instruction) {
+    fprintf(out, " at instruction %llu",
+            (unsigned long long)e.instruction);
+    if (e.have_pc) {
+      fprintf(out, " (pc %08x)", e.pc);
+    }
+  }
+  if (a.line != NULL && e.line != NULL &&
+      differing_register(a.line, e.line, &reg, &a_value, &e_value)) {
+    fprintf(out, ", register x%d: expected %08lx, got %08lx", reg,
+            e_value, a_value);
+  }
+  fprintf(out, "\n");
+  print_location(actual->name, &a, out);
+  print_location(expected->name, &e, out);
+
+  free_location(&a);
+  free_location(&e);
+}
+
+/* ---- part2_tester.py ---- */
+
+static int hex_digit(char c) {
+  return (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                                                                    : -1;
+}
+
+/* Python's re.findall("r[^=]+=([0-9a-f]+)", line), up to 4 values.
+ * Returns how many were found. */
+static int find_registers(const char *line, size_t length,
+                          unsigned long long *values) {
+  size_t i = 0, j;
+  int count = 0;
+
+  while (i < length && count < 4) {
+    if (line[i] != 'r') {
+      i++;
+      continue;
+    }
+    for (j = i + 1; j < length && line[j] != '='; j++)
+      ;
+    if (j == i + 1 || j + 1 >= length || hex_digit(line[j + 1]) < 0) {
+      i++;
+      continue;
+    }
+    values[count] = 0;
+    for (j++; j < length && hex_digit(line[j]) >= 0; j++) {
+      values[count] = values[count] * 16 + hex_digit(line[j]);
+    }
+    count++;
+    i = j;
+  }
+  return count;
+}
+
+static int contains(const char *line, size_t length, const char *word) {
+  return memmem(line, length, word, strlen(word)) != NULL;
+}
+
+static int finished(const char *line, size_t length) {
+  return length == 0 || contains(line, length, "exiting");
+}
+
+/* Checks the register dumps the way part2_tester.py does, including its
+ * rule that a register also matches if it changed by the same amount as
+ * in the reference, and its limit on the number of instructions. */
+static int compare_registers(Source *actual, Source *expected,
+                             Double max_instructions, FILE *out) {
+  unsigned long long actual_R[32] = {0}, expected_R[32] = {0};
+  unsigned long long a_values[4], e_values[4];
+  Double k, mismatches = 0;
+  const char *a_line, *e_line;
+  size_t a_length, e_length;
+  unsigned pc = 0;
+  int have_pc = 0, i, j;
+
+  for (k = 0; max_instructions == 0 || k < max_instructions; k++) {
+    for (i = 0; i < 9; i++) {
+      if (!source_line(expected, &e_line, &e_length)) {
+        e_length = 0;
+      }
+      if (!source_line(actual, &a_line, &a_length)) {
+        a_length = 0;
+      }
+
+      if (memchr(e_line, ':', e_length) != NULL) {
+        char text[16];
+
+        snprintf(text, sizeof(text), "%.*s", (int)e_length, e_line);
+        have_pc = is_pc_line(text, &pc);
+        continue;
+      }
+      if (contains(a_line, a_length, "Invalid")) {
+        fprintf(out, "instruction %llu: invalid instruction in %s: %.*s",
+                (unsigned long long)k, actual->name, (int)a_length, a_line);
+        return 1;
+      }
+
+      int a_finished = finished(a_line, a_length);
+      int e_finished = finished(e_line, e_length);
+
+      if (a_finished && e_finished) {
+        if (mismatches > 0) {
+          fprintf(out, "%llu mismatched register values\n",
+                  (unsigned long long)mismatches);
+        }
+        return mismatches > 0;
+      } else if (a_finished) {
+        fprintf(out, "instruction %llu: %s finished before %s\n",
+                (unsigned long long)k, actual->name, expected->name);
+        return 1;
+      } else if (e_finished) {
+        fprintf(out, "instruction %llu: %s finished before %s\n",
+                (unsigned long long)k, expected->name, actual->name);
+        return 1;
+      }
+
+      if (find_registers(a_line, a_length, a_values) < 4 ||
+          find_registers(e_line, e_length, e_values) < 4) {
+        fprintf(out, "instruction %llu: cannot parse\n  %s: %.*s  %s: %.*s",
+                (unsigned long long)k, actual->name, (int)a_length, a_line,
+                expected->name, (int)e_length, e_line);
+        return 1;
+      }
+
+      for (j = 0; j < 4; j++) {
+        /* a line before the first ':' line is a dump of r28-r31 to the
+         * tester, see (i-1)*4+j there */
+        int reg = ((i - 1) * 4 + j + 32) % 32;
+
+        if (a_values[j] - actual_R[reg] != e_values[j] - expected_R[reg] &&
+            a_values[j] != e_values[j]) {
+          if (mismatches++ == 0) {
+            fprintf(out, "instruction %llu", (unsigned long long)k);
+            if (have_pc) {
+              fprintf(out, " (pc %08x)", pc);
+            }
+            fprintf(out, ", register x%d: expected %08llx, got %08llx\n",
+                    reg, e_values[j], a_values[j]);
+            fprintf(out, "  %s: %.*s", expected->name, (int)e_length,
+                    e_line);
+            fprintf(out, "  %s: %.*s", actual->name, (int)a_length, a_line);
+          }
+        }
+        actual_R[reg] = a_values[j];
+        expected_R[reg] = e_values[j];
+      }
+    }
+    /* the blank line after each dump */
+    source_line(expected, &e_line, &e_length);
+    source_line(actual, &a_line, &a_length);
+  }
+
+  fprintf(out, "no end after %llu instructions, possible infinite loop\n",
+          (unsigned long long)max_instructions);
+  return 1;
+}
+
+/* ---- entry points ---- */
+
+static int open_both(Source *actual, const char *actual_name,
+                     Source *expected, const char *expected_name) {
+  if (source_open(actual, actual_name) != 0) {
+    fprintf(stderr, "Cannot open %s\n", actual_name);
+    return -1;
+  }
+  if (source_open(expected, expected_name) != 0) {
+    fprintf(stderr, "Cannot open %s\n", expected_name);
+    source_close(actual);
+    return -1;
+  }
+  return 0;
+}
+
+int compare_text_files(const char *actual_name, const char *expected_name,
+                       FILE *out) {
+  Source actual, expected;
+  int result;
+
+  if (open_both(&actual, actual_name, &expected, expected_name) != 0) {
+    return -1;
+  }
+  result = compare_text(&actual, &expected);
+  if (result != 0) {
+    report_text(&actual, &expected, out);
+  }
+  source_close(&actual);
+  source_close(&expected);
+  return result;
+}
+
+int compare_register_files(const char *actual_name,
+                           const char *expected_name,
+                           Double max_instructions, FILE *out) {
+  Source actual, expected;
+  int result;
+
+  if (open_both(&actual, actual_name, &expected, expected_name) != 0) {
+    return -1;
+  }
+  result = compare_registers(&actual, &expected, max_instructions, out);
+  source_close(&actual);
+  source_close(&expected);
+  return result;
+}
@@ -0,0 +1,21 @@
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include <stdio.h>
+#include "types.h"
+
+/* Checks a trace printed by `riscv -r -t` (or a disassembly printed by
+   `riscv -d`) against a reference, giving the verdict of the grading
+   scripts, and writes where they first diverge to out. Both return 0 if
+   the files match, 1 if they do not and -1 if one cannot be opened. Used
+   by tracecmp and runtests. */
+
+/* compare.py: the files must match once all whitespace is removed */
+int compare_text_files(const char *actual, const char *expected, FILE *out);
+
+/* part2_tester.py: the register dumps are compared one by one, for at
+   most max_instructions (0 for no limit) */
+int compare_register_files(const char *actual, const char *expected,
+                           Double max_instructions, FILE *out);
+
+#endif
@@ -0,0 +1,135 @@
+#include "cosim.h"
+#include "engine.h"
+#include "riscv.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int cosim_active = 0;
+
+static Engine *shadow;
+static Processor shadow_processor;
+static Byte *shadow_memory;
+
+static Double matched = 0;
+static int in_flight = 0;
+static Word flight_pc, flight_bits;
+/* the shadow's outcome for the instruction in flight */
+static int shadow_ended, shadow_status;
+static Address store_address;
+static int store_width;
+
+static void divergence_header(void) {
+  int length;
+  const char *text = disassembly_line(flight_pc, flight_bits, &length);
+
+  fflush(stdout);
+  fprintf(stderr,
+          "cosim: instruction %llu differs between part2.c and engine.c\n"
+          "  %.*s",
+          (unsigned long long)matched, length, text);
+}
+
+/* Either engine ending the simulation in the instruction in flight must
+ * find the other ending it too, with the same status. */
+int cosim_close(int status) {
+  if (in_flight && !shadow_ended) {
+    divergence_header();
+    fprintf(stderr, "  part2.c ends here with status %d, engine.c goes on\n",
+            status);
+    return 1;
+  }
+  if (in_flight && shadow_status != status) {
+    divergence_header();
+    fprintf(stderr, "  part2.c ends with status %d, engine.c with %d\n",
+            status, shadow_status);
+    return 1;
+  }
+  fprintf(stderr, "cosim: %llu instructions match\n",
+          (unsigned long long)matched);
+  return status;
+}
+
+int cosim_open(const Processor *processor, const Byte *memory) {
+  shadow_memory = malloc(MEMORY_SPACE);
+  if (shadow_memory == NULL) {
+    return -1;
+  }
+  memcpy(shadow_memory, memory, MEMORY_SPACE);
+  shadow_processor = *processor;
+  shadow = engine_create(shadow_memory, 1);
+  if (shadow == NULL) {
+    return -1;
+  }
+  cosim_active = 1;
+  return 0;
+}
+
+/* The shadow goes first, so an instruction that ends the simulation in
+ * part2.c can be compared in cosim_close(). */
+void cosim_begin(Word pc, Word instruction_bits) {
+  flight_pc = pc;
+  flight_bits = instruction_bits;
+  in_flight = 1;
+  store_width = 0;
+  shadow_ended = engine_step(shadow, &shadow_processor, &shadow_status);
+}
+
+void cosim_store(Address address, Alignment alignment) {
+  store_address = address;
+  store_width = alignment;
+}
+
+/* reports the bytes stored to by either engine that differ */
+static int compare_memory(const Byte *memory, Address address, int width,
+                          int differ) {
+  int i;
+
+  for (i = 0; i < width; i++) {
+    if (memory[address + i] != shadow_memory[address + i]) {
+      if (!differ++) {
+        divergence_header();
+      }
+      fprintf(stderr, "  mem[0x%08x]: part2.c %02x, engine.c %02x\n",
+              address + i, memory[address + i], shadow_memory[address + i]);
+    }
+  }
+  return differ;
+}
+
+void cosim_end(const Processor *processor, const Byte *memory) {
+  Address shadow_address;
+  int i, differ = 0, shadow_width;
+
+  in_flight = 0;
+  if (shadow_ended) {
+    divergence_header();
+    fprintf(stderr, "  engine.c ends here with status %d, part2.c goes on\n",
+            shadow_status);
+    exit(1);
+  }
+  if (processor->PC != shadow_processor.PC) {
+    differ++;
+    divergence_header();
+    fprintf(stderr, "  pc: part2.c %08x, engine.c %08x\n", processor->PC,
+            shadow_processor.PC);
+  }
+  for (i = 0; i < 32; i++) {
+    if (processor->R[i] != shadow_processor.R[i]) {
+      if (!differ++) {
+        divergence_header();
+      }
+      fprintf(stderr, "  x%d: part2.c %08x, engine.c %08x\n", i,
+              processor->R[i], shadow_processor.R[i]);
+    }
+  }
+  engine_last_store(shadow, &shadow_address, &shadow_width);
+  differ = compare_memory(memory, store_address, store_width, differ);
+  if (shadow_address != store_address || shadow_width != store_width) {
+    differ = compare_memory(memory, shadow_address, shadow_width, differ);
+  }
+  if (differ) {
+    exit(1);
+  }
+  matched++;
+}
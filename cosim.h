@@ -0,0 +1,24 @@
+#ifndef COSIM_H
+#define COSIM_H
+
+#include "types.h"
+
+/* Differential co-simulation: a quiet engine.c engine runs on a copy of
+   the processor and memory in lockstep with part2.c, and the simulation
+   stops at the first instruction after which their pc, registers or the
+   memory either of them stored to differ, or that ends one run and not
+   the other. */
+
+/* set while co-simulating, see execute() in riscv.c */
+extern int cosim_active;
+
+int cosim_open(const Processor *processor, const Byte *memory);
+void cosim_begin(Word pc, Word instruction_bits);
+/* called by store() */
+void cosim_store(Address address, Alignment alignment);
+void cosim_end(const Processor *processor, const Byte *memory);
+/* Checks that both engines end the simulation with status. Returns the
+   status to exit with: 1 if they do not, status if they do. */
+int cosim_close(int status);
+
+#endif
@@ -0,0 +1,52 @@
+#include "csr.h"
+#include <stddef.h>
+
+static Double (*count_instructions)(void) = NULL;
+
+void csr_open(Double (*instructions)(void)) {
+  count_instructions = instructions;
+}
+
+static int read_counter(Word csr, Word *value) {
+  Double started = count_instructions != NULL ? count_instructions() : 0,
+         retired = started != 0 ? started - 1 : 0;
+
+  switch (csr) {
+  case CSR_CYCLE:
+  case CSR_TIME:
+  case CSR_INSTRET:
+    *value = (Word)retired;
+    return 0;
+  case CSR_CYCLEH:
+  case CSR_TIMEH:
+  case CSR_INSTRETH:
+    *value = (Word)(retired >> 32);
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+int csr_execute(Instruction instruction, Processor *processor) {
+  Word value;
+
+  switch (instruction.itype.funct3) {
+  case 0x2: /* csrrs */
+  case 0x3: /* csrrc */
+  case 0x6: /* csrrsi */
+  case 0x7: /* csrrci */
+    /* x0, or an immediate of 0, sets or clears nothing */
+    if (instruction.itype.rs1 != 0) {
+      return -1;
+    }
+    break;
+  default: /* csrrw and csrrwi always write */
+    return -1;
+  }
+  if (read_counter(instruction.itype.imm, &value) != 0) {
+    return -1;
+  }
+  processor->R[instruction.itype.rd] = value;
+  processor->PC += 4;
+  return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include "types.h"
+
+/* The Zicsr performance counters a guest can read: cycle, time and
+   instret, and their high halves. rdcycle, rdtime and rdinstret are
+   `csrrs rd, csr, x0`. The counters are read-only, so an instruction that
+   would write one, or that names any other CSR, is invalid. They come
+   from the instruction count riscv.c keeps anyway, so they cost nothing
+   per instruction: instret counts the instructions before the one that
+   reads it, and with no timing model every instruction takes a cycle and
+   the timer ticks once a cycle. */
+#define CSR_CYCLE 0xC00
+#define CSR_TIME 0xC01
+#define CSR_INSTRET 0xC02
+#define CSR_CYCLEH 0xC80
+#define CSR_TIMEH 0xC81
+#define CSR_INSTRETH 0xC82
+
+/* Called by riscv.c with what counts the instructions started, the one
+   reading the counter included; until then the counters read 0. */
+void csr_open(Double (*instructions)(void));
+
+/* Executes a csrr* instruction, setting rd and moving the pc on, or
+   returns -1 leaving everything alone if it is invalid. */
+int csr_execute(Instruction instruction, Processor *processor);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include "types.h"
+#include <time.h>
+
+/* A cheap timestamp for attributing host cost: the time-stamp counter on
+   x86, nanoseconds elsewhere. The TSC ticks at a constant rate, which is
+   not quite the core clock, so cycles_per_second() is measured. */
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static inline Double read_cycles(void) { return __rdtsc(); }
+#else
+static inline Double read_cycles(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (Double)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+#endif
+
+/* Counts cycles over 50 ms of wall time. */
+static inline double cycles_per_second(void) {
+  struct timespec start, now;
+  Double first = read_cycles(), last;
+  double seconds;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  do {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    seconds = now.tv_sec - start.tv_sec + (now.tv_nsec - start.tv_nsec) / 1e9;
+  } while (seconds < 0.05);
+  last = read_cycles();
+  return (last - first) / seconds;
+}
+
+#endif
@@ -15,114 +15,9 @@ running = {
 grading = {
 
 }
-# Configure maxscores here
-tests_json = """{
-  "R": {
-    "Part1": {
-      "./riscv -d ./code/input/R/R.input > ./code/out/R/R.solution": 2,
-      "python3 compare.py ./code/out/R/R.solution ./code/ref/R/R.solution": 10
-    },
-    "Part2": {
-      "timeout 60 ./riscv -r -t ./code/input/R/R.input > ./code/out/R/R.trace": 0,
-      "python3 compare.py ./code/out/R/R.trace ./code/ref/R/R.trace": 0
-    }
-  },
-    "Ri": {
-    "Part1": {
-      "./riscv -d ./code/input/Ri/Ri.input > ./code/out/Ri/Ri.solution": 0,
-      "python3 compare.py ./code/out/Ri/Ri.solution ./code/ref/Ri/Ri.solution": 0
-    },
-    "Part2": {
-      "timeout 60 ./riscv -r -t -v ./code/input/Ri/Ri.input > ./code/out/Ri/Ri.trace": 2,
-      "python3 compare.py ./code/out/Ri/Ri.trace ./code/ref/Ri/Ri.trace": 10
-    }
-  },
-  "I": {
-    "Part1": {
-      "./riscv -d ./code/input/I/I.input > ./code/out/I/I.solution": 2,
-      "python3 compare.py ./code/out/I/I.solution ./code/ref/I/I.solution": 10,
-      "./riscv -d ./code/input/I/L.input > ./code/out/I/L.solution": 2,
-      "python3 compare.py ./code/out/I/L.solution ./code/ref/I/L.solution": 10
-    },
-    "Part2": {
-      "timeout 60 ./riscv -r -t ./code/input/I/I.input > ./code/out/I/I.trace": 2,
-      "python3 compare.py ./code/out/I/I.trace ./code/ref/I/I.trace": 10,
-      "timeout 60 ./riscv -r -t ./code/input/I/L.input > ./code/out/I/L.trace": 2,
-      "python3 compare.py ./code/out/I/L.trace ./code/ref/I/L.trace": 10
-    }
-  },
-  "S": {
-    "Part1": {
-      "./riscv -d ./code/input/S/S.input > ./code/out/S/S.solution": 2,
-      "python3 compare.py ./code/out/S/S.solution ./code/ref/S/S.solution": 10
-    },
-    "Part2": {
-      "timeout 60 ./riscv -r -t ./code/input/S/S.input > ./code/out/S/S.trace": 2,
-      "python3 compare.py ./code/out/S/S.trace ./code/ref/S/S.trace": 10
-    }
-  },
-  "SB": {
-    "Part1": {
-      "./riscv -d ./code/input/SB/SB.input > ./code/out/SB/SB.solution": 2,
-      "python3 compare.py ./code/out/SB/SB.solution ./code/ref/SB/SB.solution": 10
-    },
-    "Part2": {
-      "timeout 60 ./riscv -r -t ./code/input/SB/SB.input > ./code/out/SB/SB.trace": 2,
-      "python3 compare.py ./code/out/SB/SB.trace ./code/ref/SB/SB.trace": 10
-    }
-
-  },
-  "U": {
-    "Part1": {
-      "./riscv -d ./code/input/U/U.input > ./code/out/U/U.solution": 2,
-      "python3 compare.py ./code/out/U/U.solution ./code/ref/U/U.solution": 10
-    },
-  "Part2": {
-      "timeout 60 ./riscv -r -t ./code/input/U/U.input > ./code/out/U/U.trace": 2,
-      "python3 compare.py ./code/out/U/U.trace ./code/ref/U/U.trace": 10
-    }
-
-  },
-  "UJ": {
-    "Part1": {
-      "./riscv -d ./code/input/UJ/UJ.input > ./code/out/UJ/UJ.solution": 2,
-      "python3 compare.py ./code/out/UJ/UJ.solution ./code/ref/UJ/UJ.solution": 10
-    },
-    "Part2": {
-      "timeout 60 ./riscv -r -t ./code/input/UJ/UJ.input > ./code/out/UJ/UJ.trace": 2,
-      "python3 compare.py ./code/out/UJ/UJ.trace ./code/ref/UJ/UJ.trace": 10
-    }
-  },
-  "lswc": {
-     "Part1": {
-       "./riscv -d ./code/input/custom_lswc.input > ./code/out/custom_lswc.solution": 0,
-       "python3 compare.py ./code/out/custom_lswc.solution ./code/ref/custom_lswc.solution": 30
-     },
-     "Part2": {
-       "timeout 60 ./riscv -t -e -r -s ./code/input/lswc_data.input  -a 0x8,0x3000 ./code/input/custom_lswc.input > code/out/custom_lswc.trace": 0,
-       "python3 part2_tester.py custom_lswc": 120
-     }
-   },
-  "All": {
-    "Part1": {
-      "./riscv -d ./code/input/simple.input > ./code/out/simple.solution": 0,
-      "python3 compare.py ./code/out/simple.solution ./code/ref/simple.solution": 30,
-      "./riscv -d ./code/input/multiply.input > ./code/out/multiply.solution": 0,
-      "python3 compare.py ./code/out/multiply.solution ./code/ref/multiply.solution": 30,
-      "./riscv -d ./code/input/random.input > ./code/out/random.solution": 0,
-      "python3 compare.py ./code/out/random.solution ./code/ref/random.solution": 30
-    },
-    "Part2": {
-      "timeout 60 ./riscv -r -t -e ./code/input/simple.input > ./code/out/simple.trace": 0,
-      "python3 part2_tester.py simple": 30,
-      "timeout 60 ./riscv -r -t -e ./code/input/multiply.input > ./code/out/multiply.trace": 0,
-      "python3 part2_tester.py multiply": 30,
-      "timeout 60 ./riscv -r -t -e ./code/input/random.input > ./code/out/random.trace": 0,
-      "python3 part2_tester.py random": 30
-    }
-  }
-}
-"""
+# Configure maxscores in tests.json, which runtests reads too
+with open(os.path.join(os.path.dirname(os.path.abspath(__file__)), "tests.json")) as tests_file:
+    tests_json = tests_file.read()
 
 
   # "mac": {
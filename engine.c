@@ -0,0 +1,463 @@
+#include "engine.h"
+#include "csr.h"
+#include "riscv.h"
+#include "roi.h"
+#include "statehash.h"
+#include "stats.h"
+#include "trace.h"
+#include "utils.h"
+#include <stdlib.h>
+
+enum {
+  OP_UNDECODED,
+  OP_ADD, OP_SUB, OP_MUL, OP_MULH, OP_SLL, OP_SLT, OP_XOR, OP_DIV,
+  OP_SRL, OP_SRA, OP_OR, OP_REM, OP_AND, OP_NOP,
+  OP_ADDI, OP_SLLI, OP_SLTI, OP_XORI, OP_SRLI, OP_SRAI, OP_ORI, OP_ANDI,
+  OP_LB, OP_LH, OP_LW, OP_SB, OP_SH, OP_SW,
+  OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_JAL, OP_LUI,
+  /* left to part2.c by a loud engine */
+  OP_ECALL,
+  OP_CSR,
+  OP_INVALID,         /* printed, then exits */
+  OP_INVALID_NO_EXIT, /* printed, then goes on to the next instruction */
+};
+
+/* --stats counts by op; the ones left to part2.c are counted there */
+#ifdef SIM_STATS
+static const Byte stat_by_op[OP_ECALL] = {
+    0, STAT_ADD, STAT_SUB, STAT_MUL, STAT_MULH, STAT_SLL, STAT_SLT, STAT_XOR,
+    STAT_DIV, STAT_SRL, STAT_SRA, STAT_OR, STAT_REM, STAT_AND, STAT_INVALID,
+    STAT_ADDI, STAT_SLLI, STAT_SLTI, STAT_XORI, STAT_SRLI, STAT_SRAI,
+    STAT_ORI, STAT_ANDI, STAT_LB, STAT_LH, STAT_LW, STAT_SB, STAT_SH, STAT_SW,
+    STAT_BEQ, STAT_BNE, STAT_BLT, STAT_BGE, STAT_JAL, STAT_LUI};
+#endif
+
+/* a quiet engine runs in a shadow or under the fuzzer, not for --stats */
+#define COUNT(event) (engine->quiet ? (void)0 : STATS_COUNT(event))
+#define COUNT_BRANCH(taken) (engine->quiet ? (void)0 : STATS_BRANCH(taken))
+
+typedef struct {
+  Word bits;
+  Byte op, rd, rs1, rs2;
+  sWord imm;
+  Double entries; /* --block-profile: blocks started here */
+} Decoded;
+
+struct Engine {
+  Byte *memory;
+  int quiet;
+  Address store_address;
+  int store_width;
+  int counting_blocks, block_start; /* the last instruction branched */
+  Decoded decoded[MEMORY_SPACE / 4]; /* by pc / 4 */
+};
+
+static Decoded decode(Word bits) {
+  Instruction instruction = parse_instruction(bits);
+  Decoded d = {bits, OP_INVALID, instruction.rtype.rd, instruction.rtype.rs1,
+               instruction.rtype.rs2, 0};
+  int funct3 = instruction.rtype.funct3, funct7 = instruction.rtype.funct7;
+
+  switch (instruction.opcode) {
+  case 0x33:
+    switch (funct3) {
+    case 0x0:
+      d.op = funct7 == 0x0    ? OP_ADD
+             : funct7 == 0x1  ? OP_MUL
+             : funct7 == 0x20 ? OP_SUB
+                              : OP_INVALID;
+      break;
+    case 0x1:
+      /* part2.c ignores the other funct7s */
+      d.op = funct7 == 0x0 ? OP_SLL : funct7 == 0x1 ? OP_MULH : OP_NOP;
+      break;
+    case 0x2:
+      d.op = OP_SLT;
+      break;
+    case 0x4:
+      d.op = funct7 == 0x0 ? OP_XOR : funct7 == 0x1 ? OP_DIV : OP_INVALID;
+      break;
+    case 0x5:
+      d.op = funct7 == 0x0 ? OP_SRL : funct7 == 0x20 ? OP_SRA : OP_INVALID;
+      break;
+    case 0x6:
+      d.op = funct7 == 0x0 ? OP_OR : funct7 == 0x1 ? OP_REM : OP_INVALID;
+      break;
+    case 0x7:
+      d.op = OP_AND;
+      break;
+    }
+    break;
+  case 0x13:
+    d.imm = sign_extend_number(instruction.itype.imm, 12);
+    switch (funct3) {
+    case 0x0:
+      d.op = OP_ADDI;
+      break;
+    case 0x1:
+      d.op = OP_SLLI;
+      d.imm = instruction.itype.imm & 0x1F;
+      break;
+    case 0x2:
+      d.op = OP_SLTI;
+      break;
+    case 0x4:
+      d.op = OP_XORI;
+      break;
+    case 0x5:
+      d.op = instruction.itype.imm >> 10 == 0x0   ? OP_SRLI
+             : instruction.itype.imm >> 10 == 0x1 ? OP_SRAI
+                                                  : OP_INVALID;
+      d.imm = instruction.itype.imm & 0x1F;
+      break;
+    case 0x6:
+      d.op = OP_ORI;
+      break;
+    case 0x7:
+      d.op = OP_ANDI;
+      break;
+    default:
+      d.op = OP_INVALID_NO_EXIT;
+      break;
+    }
+    break;
+  case 0x03:
+    d.imm = sign_extend_number(instruction.itype.imm, 12);
+    d.op = funct3 == 0x0   ? OP_LB
+           : funct3 == 0x1 ? OP_LH
+           : funct3 == 0x2 ? OP_LW
+                           : OP_INVALID_NO_EXIT;
+    break;
+  case 0x23:
+    d.imm = get_store_offset(instruction);
+    d.op = funct3 == 0x0   ? OP_SB
+           : funct3 == 0x1 ? OP_SH
+           : funct3 == 0x2 ? OP_SW
+                           : OP_INVALID;
+    break;
+  case 0x63:
+    d.imm = get_branch_offset(instruction);
+    d.op = funct3 == 0x0   ? OP_BEQ
+           : funct3 == 0x1 ? OP_BNE
+           : funct3 == 0x4 ? OP_BLT
+           : funct3 == 0x5 ? OP_BGE
+                           : OP_INVALID;
+    break;
+  case 0x6F:
+    d.op = OP_JAL;
+    d.imm = get_jump_offset(instruction);
+    break;
+  case 0x37:
+    d.op = OP_LUI;
+    d.imm = (Word)instruction.utype.imm << 12;
+    break;
+  case 0x73:
+    d.op = funct3 == 0x0 ? OP_ECALL : OP_CSR;
+    break;
+  }
+  return d;
+}
+
+Engine *engine_create(Byte *memory, int quiet) {
+  Engine *engine = calloc(1, sizeof(Engine));
+
+  if (engine != NULL) {
+    engine->memory = memory;
+    engine->quiet = quiet;
+  }
+  return engine;
+}
+
+void engine_count_blocks(Engine *engine) {
+  engine->counting_blocks = 1;
+  engine->block_start = 1;
+}
+
+Double engine_block_entries(const Engine *engine, Address pc) {
+  return engine->decoded[pc / 4].entries;
+}
+
+/* the opcodes of the ops engine_step() starts a block after */
+int engine_ends_block(Word bits) {
+  Word opcode = bits & 0x7F;
+
+  return opcode == 0x63 || opcode == 0x6F || opcode == 0x73;
+}
+
+void engine_last_store(const Engine *engine, Address *address, int *width) {
+  *address = engine->store_address;
+  *width = engine->store_width;
+}
+
+static Word read_word(const Byte *memory, Address address) {
+  return (Word)memory[address] | (Word)memory[address + 1] << 8 |
+         (Word)memory[address + 2] << 16 | (Word)memory[address + 3] << 24;
+}
+
+/* see load() in part2.c */
+static int engine_load(Engine *engine, Address address, Alignment alignment,
+                       Word *value) {
+  const Byte *memory = engine->memory;
+
+  if (address > MEMORY_SPACE - alignment) {
+    if (!engine->quiet) {
+      handle_invalid_read(address);
+    }
+    return -1;
+  }
+  switch (alignment) {
+  case LENGTH_BYTE:
+    *value = (Word)(sWord)(sByte)memory[address];
+    break;
+  case LENGTH_HALF_WORD:
+    *value = (Word)(sWord)(sHalf)(memory[address] | memory[address + 1] << 8);
+    break;
+  default:
+    *value = read_word(memory, address);
+    break;
+  }
+  if (trace_active && !engine->quiet) {
+    trace_mem_access(address, alignment, *value, 0);
+  }
+  return 0;
+}
+
+/* see store() in part2.c */
+static int engine_store(Engine *engine, Address address, Alignment alignment,
+                        Word value) {
+  Byte *memory = engine->memory;
+  int i;
+
+  if (address > MEMORY_SPACE - alignment) {
+    if (!engine->quiet) {
+      handle_invalid_write(address);
+    }
+    return -1;
+  }
+  if (statehash_active && !engine->quiet) {
+    statehash_store(memory, address, alignment, value);
+  }
+  for (i = 0; i < alignment; i++) {
+    memory[address + i] = value >> (8 * i);
+  }
+  engine->store_address = address;
+  engine->store_width = alignment;
+  if (trace_active && !engine->quiet) {
+    trace_mem_access(address, alignment, value, 1);
+  }
+  return 0;
+}
+
+/* execute_ecall() in part2.c without its output; the print ecalls leave
+ * the pc alone */
+static int quiet_ecall(Processor *processor, int *status) {
+  switch (processor->R[10]) {
+  case 1:
+  case 4:
+  case 11:
+    return 0;
+  /* a shadow leaves the regions of interest to the simulator */
+  case ROI_BEGIN:
+  case ROI_END:
+  case ROI_RESET:
+  case ROI_DUMP:
+    processor->PC += 4;
+    return 0;
+  case 10:
+    *status = 0;
+    return 1;
+  default:
+    *status = -1;
+    return 1;
+  }
+}
+
+int engine_step(Engine *engine, Processor *processor, int *status) {
+  Word pc = processor->PC, *R = processor->R, bits, value;
+  Decoded *d;
+
+  engine->store_width = 0;
+  if (pc > MEMORY_SPACE - LENGTH_WORD) {
+    if (!engine->quiet) {
+      handle_invalid_read(pc);
+    }
+    *status = -1;
+    return 1;
+  }
+  bits = read_word(engine->memory, pc);
+  d = &engine->decoded[pc / 4];
+  if (d->op == OP_UNDECODED || d->bits != bits) {
+    Double entries = d->entries;
+
+    *d = decode(bits);
+    d->entries = entries;
+  }
+  /* a block starts after every branch and jump, taken or not, and after
+   * the system instructions, which may go on to the next one */
+  if (engine->counting_blocks) {
+    d->entries += engine->block_start;
+    engine->block_start = (d->op >= OP_BEQ && d->op <= OP_JAL) ||
+                          d->op == OP_ECALL || d->op == OP_CSR;
+  }
+  if (d->op < OP_ECALL) {
+    COUNT(stat_by_op[d->op]);
+  }
+
+  switch (d->op) {
+  case OP_ADD:
+    R[d->rd] = R[d->rs1] + R[d->rs2];
+    break;
+  case OP_SUB:
+    R[d->rd] = R[d->rs1] - R[d->rs2];
+    break;
+  case OP_MUL:
+    R[d->rd] = R[d->rs1] * R[d->rs2];
+    break;
+  case OP_MULH:
+    R[d->rd] = (Word)(((sDouble)(sWord)R[d->rs1] * (sWord)R[d->rs2]) >> 32);
+    break;
+  case OP_SLL:
+    R[d->rd] = R[d->rs1] << (R[d->rs2] & 0x1F);
+    break;
+  case OP_SLT:
+    R[d->rd] = (sWord)R[d->rs1] < (sWord)R[d->rs2];
+    break;
+  case OP_XOR:
+    R[d->rd] = R[d->rs1] ^ R[d->rs2];
+    break;
+  case OP_DIV:
+    /* INT_MIN / -1 overflows in C */
+    if (R[d->rs2] == 0) {
+      R[d->rd] = 0xFFFFFFFF;
+    } else if (R[d->rs1] == 0x80000000 && R[d->rs2] == 0xFFFFFFFF) {
+      R[d->rd] = 0x80000000;
+    } else {
+      R[d->rd] = (sWord)R[d->rs1] / (sWord)R[d->rs2];
+    }
+    break;
+  case OP_SRL:
+    R[d->rd] = R[d->rs1] >> (R[d->rs2] & 0x1F);
+    break;
+  case OP_SRA:
+    R[d->rd] = (sWord)R[d->rs1] >> (R[d->rs2] & 0x1F);
+    break;
+  case OP_OR:
+    R[d->rd] = R[d->rs1] | R[d->rs2];
+    break;
+  case OP_REM:
+    if (R[d->rs2] == 0) {
+      R[d->rd] = R[d->rs1];
+    } else if (R[d->rs1] == 0x80000000 && R[d->rs2] == 0xFFFFFFFF) {
+      R[d->rd] = 0;
+    } else {
+      R[d->rd] = (sWord)R[d->rs1] % (sWord)R[d->rs2];
+    }
+    break;
+  case OP_AND:
+    R[d->rd] = R[d->rs1] & R[d->rs2];
+    break;
+  case OP_NOP:
+    break;
+  case OP_ADDI:
+    R[d->rd] = R[d->rs1] + d->imm;
+    break;
+  case OP_SLLI:
+    R[d->rd] = R[d->rs1] << d->imm;
+    break;
+  case OP_SLTI:
+    R[d->rd] = (sWord)R[d->rs1] < d->imm;
+    break;
+  case OP_XORI:
+    R[d->rd] = R[d->rs1] ^ d->imm;
+    break;
+  case OP_SRLI:
+    R[d->rd] = R[d->rs1] >> d->imm;
+    break;
+  case OP_SRAI:
+    R[d->rd] = (sWord)R[d->rs1] >> d->imm;
+    break;
+  case OP_ORI:
+    R[d->rd] = R[d->rs1] | d->imm;
+    break;
+  case OP_ANDI:
+    R[d->rd] = R[d->rs1] & d->imm;
+    break;
+  case OP_LB:
+  case OP_LH:
+  case OP_LW:
+    if (engine_load(engine, R[d->rs1] + d->imm,
+                    d->op == OP_LB   ? LENGTH_BYTE
+                    : d->op == OP_LH ? LENGTH_HALF_WORD
+                                     : LENGTH_WORD,
+                    &value) != 0) {
+      *status = -1;
+      return 1;
+    }
+    R[d->rd] = value;
+    break;
+  case OP_SB:
+  case OP_SH:
+  case OP_SW:
+    if (engine_store(engine, R[d->rs1] + d->imm,
+                     d->op == OP_SB   ? LENGTH_BYTE
+                     : d->op == OP_SH ? LENGTH_HALF_WORD
+                                      : LENGTH_WORD,
+                     R[d->rs2]) != 0) {
+      *status = -1;
+      return 1;
+    }
+    break;
+  /* part2.c moves a further 4 after either outcome, so taken branches go
+   * to the instruction after the target and the others skip one */
+  case OP_BEQ:
+    COUNT_BRANCH(R[d->rs1] == R[d->rs2]);
+    processor->PC += R[d->rs1] == R[d->rs2] ? d->imm : 4;
+    break;
+  case OP_BNE:
+    COUNT_BRANCH(R[d->rs1] != R[d->rs2]);
+    processor->PC += R[d->rs1] != R[d->rs2] ? d->imm : 4;
+    break;
+  case OP_BLT:
+    COUNT_BRANCH((sWord)R[d->rs1] < (sWord)R[d->rs2]);
+    processor->PC += (sWord)R[d->rs1] < (sWord)R[d->rs2] ? d->imm : 4;
+    break;
+  case OP_BGE:
+    COUNT_BRANCH((sWord)R[d->rs1] >= (sWord)R[d->rs2]);
+    processor->PC += (sWord)R[d->rs1] >= (sWord)R[d->rs2] ? d->imm : 4;
+    break;
+  case OP_JAL:
+    R[d->rd] = pc + 4;
+    processor->PC += d->imm;
+    R[0] = 0;
+    return 0;
+  case OP_LUI:
+    R[d->rd] = d->imm;
+    break;
+  default:
+    /* rare enough to leave to part2.c, which prints what they print */
+    if (!engine->quiet) {
+      execute_instruction(bits, processor, engine->memory);
+      R[0] = 0;
+      return 0;
+    }
+    if (d->op == OP_ECALL) {
+      return quiet_ecall(processor, status);
+    }
+    if (d->op == OP_CSR) {
+      if (csr_execute(parse_instruction(bits), processor) != 0) {
+        *status = -1;
+        return 1;
+      }
+      R[0] = 0;
+      return 0;
+    }
+    if (d->op == OP_INVALID) {
+      *status = -1;
+      return 1;
+    }
+    break;
+  }
+  processor->PC += 4;
+  R[0] = 0;
+  return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "types.h"
+
+/* A second execution engine with the semantics of execute_instruction()
+   in part2.c, quirks included, that decodes each instruction once: the
+   decoded form is kept per address and reused for as long as the word in
+   memory still matches it. `--fast` runs programs on it and `--cosim`
+   runs it in lockstep with part2.c. */
+
+typedef struct Engine Engine;
+
+/* A loud engine prints, calls the trace and state-hash hooks and exits
+   the way part2.c does. A quiet one does none of that, so it can shadow
+   the simulator on a copy of its state; see cosim.c. */
+Engine *engine_create(Byte *memory, int quiet);
+
+/* Executes the instruction at processor->PC. A quiet engine returns 1 if
+   it ends the simulation, setting status to the exit status, and 0
+   otherwise; a loud one exits instead. */
+int engine_step(Engine *engine, Processor *processor, int *status);
+
+/* --block-profile: from now on the engine counts how often a block of
+   instructions starts at each address. Blocks end at the instructions
+   engine_ends_block() is true for: branches, jumps, ecalls and CSR
+   instructions. */
+void engine_count_blocks(Engine *engine);
+Double engine_block_entries(const Engine *engine, Address pc);
+int engine_ends_block(Word bits);
+
+/* what a quiet engine's last instruction stored, a width of 0 if nothing */
+void engine_last_store(const Engine *engine, Address *address, int *width);
+
+#endif
@@ -0,0 +1,554 @@
+#include "engine.h"
+#include "mnemonic.h"
+#include "riscv.h"
+#include "roi.h"
+#include "utils.h"
+#include <getopt.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Fuzzes the decoder and both execution engines in one process: each case
+ * is a short random or mutated instruction stream with random registers,
+ * disassembled with part1.c and run for a bounded number of instructions
+ * on part2.c and on a quiet engine.c, which must agree on every
+ * instruction. The engine counts blocks as for --block-profile, and must
+ * count one start after each instruction that ends a block. Ends the
+ * simulation through exit_hook instead of exit(), and resets only the
+ * memory a case wrote, so cases run back to back.
+ *
+ *   fuzz [-s seed] [-n cases] [-t seconds] [-m steps] [seed.input...]
+ *   fuzz -s seed -c case        (reruns one case, printing it)
+ *
+ * Seed programs are mutated for some of the cases. Built with
+ * -fsanitize=undefined, so undefined behaviour on the host aborts like a
+ * crash; either prints the case that caused it. Exits 0 if all cases
+ * pass, 1 on a divergence. */
+
+#define MAX_PROGRAM 16
+#define CODE_START 0x1000
+
+typedef struct {
+  Double number;
+  int length;
+  Word program[MAX_PROGRAM];
+  Processor start;
+} Case;
+
+typedef struct {
+  Word *words;
+  int count;
+} Seed;
+
+static Double base_seed = 1;
+static int max_steps = 64;
+static Seed *seeds = NULL;
+static int seed_count = 0;
+
+static Byte *reference_memory, *engine_memory;
+static Engine *engine;
+static Processor reference;
+static Case current;
+static int current_step = -1;
+
+/* memory written by the case, zeroed again after it */
+typedef struct {
+  Address address;
+  int width;
+} Range;
+
+static Range *dirty;
+static int dirty_count, dirty_capacity;
+
+/* ---- statistics ---- */
+
+enum { END_EXIT, END_ERROR, END_STEPS, END_KINDS };
+static const char *const end_names[END_KINDS] = {"exit ecall", "error",
+                                                 "step limit"};
+static Double ended[END_KINDS], instructions = 0, cases_run = 0;
+
+/* executed instructions by mnemonic */
+static Double mnemonic_counts[MAX_MNEMONICS];
+static char error_kinds[8][24];
+static Double error_counts[8];
+static int error_kind_count = 0;
+
+/* ---- generation ---- */
+
+static Double rng;
+
+static Double next_random(void) {
+  Double x = (rng += 0x9e3779b97f4a7c15ULL);
+
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* Lemire's multiply-shift, as a modulo costs more than the generator */
+static Word below(Word n) { return (next_random() >> 32) * n >> 32; }
+
+/* values that find the corner cases, and addresses that mostly hit memory */
+static Word interesting_value(void) {
+  static const Word values[] = {0,          1,          2,  4,  10, 11,
+                                0xFFFFFFFF, 0x80000000, 0x7FFFFFFF,
+                                0xFFFFF800, 0x7FF,      31, 32,
+                                ROI_BEGIN,  ROI_END,    ROI_DUMP};
+
+  switch (below(4)) {
+  case 0:
+    return values[below(sizeof(values) / sizeof(values[0]))];
+  case 1:
+    return below(MEMORY_SPACE);
+  case 2:
+    return MEMORY_SPACE - below(8);
+  default:
+    return next_random();
+  }
+}
+
+/* an instruction with a valid opcode and a funct7 part2.c knows, mostly */
+static Word structured_instruction(void) {
+  static const Word opcodes[] = {0x33, 0x13, 0x03, 0x23,
+                                 0x63, 0x6F, 0x37, 0x73};
+  static const Word funct7s[] = {0x00, 0x01, 0x20};
+  Word bits = (Word)next_random() & ~0x7FU;
+
+  bits |= opcodes[below(sizeof(opcodes) / sizeof(opcodes[0]))];
+  if (below(4) != 0) {
+    bits = (bits & 0x01FFFFFF) | funct7s[below(3)] << 25;
+  }
+  return bits;
+}
+
+static void mutate_seed(Case *c) {
+  Seed *seed = &seeds[below(seed_count)];
+  int start = below(seed->count), i, mutations = 1 + below(4);
+
+  c->length = seed->count - start;
+  if (c->length > MAX_PROGRAM) {
+    c->length = MAX_PROGRAM;
+  }
+  memcpy(c->program, seed->words + start, c->length * sizeof(Word));
+  for (i = 0; i < mutations; i++) {
+    Word *word = &c->program[below(c->length)];
+
+    if (below(2)) {
+      *word ^= 1U << below(32);
+    } else {
+      *word = structured_instruction();
+    }
+  }
+}
+
+static void generate(Case *c, Double number) {
+  int i, mode;
+
+  rng = base_seed ^ number * 0xd1b54a32d192ed03ULL;
+  c->number = number;
+  memset(&c->start, 0, sizeof(c->start));
+  for (i = 1; i < 32; i++) {
+    c->start.R[i] = interesting_value();
+  }
+  c->start.PC = CODE_START;
+
+  mode = below(seed_count > 0 ? 8 : 4);
+  if (mode >= 4) {
+    mutate_seed(c);
+    return;
+  }
+  c->length = 1 + below(MAX_PROGRAM);
+  for (i = 0; i < c->length; i++) {
+    c->program[i] = mode == 0 ? (Word)next_random() : structured_instruction();
+  }
+}
+
+static int load_seed(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  char line[64];
+  Seed seed = {NULL, 0};
+
+  if (file == NULL) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), file) != NULL) {
+    seed.words = realloc(seed.words, (seed.count + 1) * sizeof(Word));
+    seed.words[seed.count++] = strtoul(line, NULL, 16);
+  }
+  fclose(file);
+  if (seed.count > 0) {
+    seeds = realloc(seeds, (seed_count + 1) * sizeof(Seed));
+    seeds[seed_count++] = seed;
+  }
+  return 0;
+}
+
+/* ---- reporting ---- */
+
+static void print_case(FILE *out) {
+  char line[DISASM_LINE_SIZE];
+  int i;
+
+  fprintf(out, "case %llu of seed %llu", (unsigned long long)current.number,
+          (unsigned long long)base_seed);
+  if (current_step >= 0) {
+    fprintf(out, ", instruction %d", current_step);
+  }
+  fprintf(out, "\n  registers:");
+  for (i = 1; i < 32; i++) {
+    fprintf(out, "%s x%d=%08x", i % 6 == 0 ? "\n   " : "", i,
+            current.start.R[i]);
+  }
+  fprintf(out, "\n  program:\n");
+  for (i = 0; i < current.length; i++) {
+    disassemble_instruction(line, current.program[i]);
+    fprintf(out, "    %08x: %08x  %s", CODE_START + 4 * i, current.program[i],
+            line);
+  }
+}
+
+static void crash_handler(int sig) {
+  fflush(stdout);
+  fprintf(stderr, "fuzz: signal %d in ", sig);
+  print_case(stderr);
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/* -fno-sanitize-recover stops at the first undefined behaviour; aborting
+ * there reaches crash_handler() */
+const char *__ubsan_default_options(void) { return "abort_on_error=1"; }
+
+/* ---- running ---- */
+
+static jmp_buf trap;
+static int trap_status;
+static char last_output[24];
+
+static void trap_exit(int status) {
+  trap_status = status;
+  longjmp(trap, 1);
+}
+
+/* the output is only looked at to tell errors apart */
+static int keep_last_output(const char *text, int length) {
+  snprintf(last_output, sizeof(last_output), "%.*s", length, text);
+  return 1;
+}
+
+static void add_dirty(Address address, int width) {
+  if (dirty_count < dirty_capacity) {
+    dirty[dirty_count].address = address;
+    dirty[dirty_count].width = width;
+  }
+  dirty_count++;
+}
+
+static void reset_memory(void) {
+  int i;
+
+  if (dirty_count > dirty_capacity) {
+    memset(reference_memory, 0, MEMORY_SPACE);
+    memset(engine_memory, 0, MEMORY_SPACE);
+  } else {
+    for (i = 0; i < dirty_count; i++) {
+      memset(reference_memory + dirty[i].address, 0, dirty[i].width);
+      memset(engine_memory + dirty[i].address, 0, dirty[i].width);
+    }
+  }
+  dirty_count = 0;
+}
+
+/* The store part2.c is about to do, so its bytes are compared even if
+ * engine.c stores elsewhere. */
+static void note_store(Word bits) {
+  Instruction instruction = parse_instruction(bits);
+  Address address;
+  int width;
+
+  if (instruction.opcode != 0x23 || instruction.stype.funct3 > 2) {
+    return;
+  }
+  width = 1 << instruction.stype.funct3;
+  address = reference.R[instruction.stype.rs1] + get_store_offset(instruction);
+  if (address <= MEMORY_SPACE - width) {
+    add_dirty(address, width);
+  }
+}
+
+static void count_mnemonic(Word bits) {
+  int id = mnemonic_id(bits);
+
+  if (id >= 0) {
+    mnemonic_counts[id]++;
+  }
+}
+
+static void count_error(void) {
+  int i, length = strcspn(last_output, ".:-0123456789\n");
+
+  while (length > 0 && last_output[length - 1] == ' ') {
+    length--;
+  }
+  last_output[length] = '\0';
+  for (i = 0; i < error_kind_count; i++) {
+    if (strcmp(error_kinds[i], last_output) == 0) {
+      break;
+    }
+  }
+  if (i == error_kind_count && error_kind_count < 8) {
+    strcpy(error_kinds[error_kind_count++], last_output);
+  }
+  if (i < 8) {
+    error_counts[i]++;
+  }
+}
+
+static int diverged(const Processor *shadow, int reference_ended,
+                    int engine_ended, int engine_status) {
+  int i, differ = 0;
+
+  if (reference_ended != engine_ended ||
+      (reference_ended && trap_status != engine_status)) {
+    fprintf(stderr, "fuzz: the engines disagree on ending, ");
+    print_case(stderr);
+    fprintf(stderr, "  part2.c: %s %d, engine.c: %s %d\n",
+            reference_ended ? "ends with" : "goes on", trap_status,
+            engine_ended ? "ends with" : "goes on", engine_status);
+    return 1;
+  }
+  for (i = 0; i < 32; i++) {
+    differ |= reference.R[i] != shadow->R[i];
+  }
+  for (i = 0; i < dirty_count && i < dirty_capacity; i++) {
+    differ |= memcmp(reference_memory + dirty[i].address,
+                     engine_memory + dirty[i].address, dirty[i].width) != 0;
+  }
+  if (!differ && reference.PC == shadow->PC) {
+    return 0;
+  }
+
+  fprintf(stderr, "fuzz: the engines differ after ");
+  print_case(stderr);
+  if (reference.PC != shadow->PC) {
+    fprintf(stderr, "  pc: part2.c %08x, engine.c %08x\n", reference.PC,
+            shadow->PC);
+  }
+  for (i = 0; i < 32; i++) {
+    if (reference.R[i] != shadow->R[i]) {
+      fprintf(stderr, "  x%d: part2.c %08x, engine.c %08x\n", i,
+              reference.R[i], shadow->R[i]);
+    }
+  }
+  for (i = 0; i < dirty_count && i < dirty_capacity; i++) {
+    int j;
+
+    for (j = 0; j < dirty[i].width; j++) {
+      Address a = dirty[i].address + j;
+
+      if (reference_memory[a] != engine_memory[a]) {
+        fprintf(stderr, "  mem[0x%08x]: part2.c %02x, engine.c %02x\n", a,
+                reference_memory[a], engine_memory[a]);
+      }
+    }
+  }
+  return 1;
+}
+
+/* Runs the current case. Returns 0 if the engines agree throughout. */
+static int run_case(void) {
+  char line[DISASM_LINE_SIZE];
+  Processor shadow = current.start;
+  int i, engine_ended = 0, engine_status = 0, block_ended = 0;
+  volatile int reference_ended = 0;
+
+  current_step = -1;
+  for (i = 0; i < current.length; i++) {
+    Address address = CODE_START + 4 * i;
+    int j;
+
+    /* the decoder must produce one line that fits */
+    disassemble_instruction(line, current.program[i]);
+    if (memchr(line, '\n', DISASM_LINE_SIZE) == NULL) {
+      fprintf(stderr, "fuzz: bad disassembly of %08x in ",
+              current.program[i]);
+      print_case(stderr);
+      return 1;
+    }
+    for (j = 0; j < 4; j++) {
+      reference_memory[address + j] = engine_memory[address + j] =
+          current.program[i] >> (8 * j);
+    }
+  }
+  add_dirty(CODE_START, 4 * current.length);
+  reference = current.start;
+
+  for (current_step = 0; current_step < max_steps; current_step++) {
+    if (setjmp(trap) == 0) {
+      Word bits = load(reference_memory, reference.PC, LENGTH_WORD);
+
+      note_store(bits);
+      count_mnemonic(bits);
+      execute_instruction(bits, &reference, reference_memory);
+      reference.R[0] = 0;
+    } else {
+      reference_ended = 1;
+    }
+    Address pc = shadow.PC;
+    int in_memory = pc <= MEMORY_SPACE - LENGTH_WORD;
+    Double entries = in_memory ? engine_block_entries(engine, pc) : 0;
+    Word engine_bits = in_memory ? load(engine_memory, pc, LENGTH_WORD) : 0;
+
+    engine_ended = engine_step(engine, &shadow, &engine_status);
+    if (engine_ended == 0) {
+      Address address;
+      int width;
+
+      engine_last_store(engine, &address, &width);
+      if (width > 0) {
+        add_dirty(address, width);
+      }
+    }
+    instructions++;
+    if (diverged(&shadow, reference_ended, engine_ended, engine_status)) {
+      return 1;
+    }
+    /* the first step follows the previous case's last */
+    if (in_memory && current_step > 0 &&
+        (engine_block_entries(engine, pc) != entries) != block_ended) {
+      fprintf(stderr, "fuzz: engine.c %s a block at %08x in ",
+              block_ended ? "does not start" : "starts", pc);
+      print_case(stderr);
+      return 1;
+    }
+    block_ended = engine_ends_block(engine_bits);
+    if (reference_ended) {
+      if (trap_status == 0) {
+        ended[END_EXIT]++;
+      } else {
+        ended[END_ERROR]++;
+        count_error();
+      }
+      return 0;
+    }
+  }
+  ended[END_STEPS]++;
+  return 0;
+}
+
+static void print_statistics(double seconds) {
+  int i;
+
+  fflush(stdout);
+  fprintf(stderr,
+          "fuzz: %llu cases, %llu instructions in %.2f s: %.0f cases/s, "
+          "%.0f instructions/s\n",
+          (unsigned long long)cases_run, (unsigned long long)instructions,
+          seconds, cases_run / seconds, instructions / seconds);
+  fprintf(stderr, "  ended by:");
+  for (i = 0; i < END_KINDS; i++) {
+    fprintf(stderr, " %s %llu%s", end_names[i], (unsigned long long)ended[i],
+            i + 1 < END_KINDS ? "," : "\n");
+  }
+  for (i = 0; i < error_kind_count; i++) {
+    fprintf(stderr, "    %s: %llu\n", error_kinds[i],
+            (unsigned long long)error_counts[i]);
+  }
+  fprintf(stderr, "  %d mnemonics executed:", mnemonics_seen());
+  for (i = 0; i < mnemonics_seen(); i++) {
+    fprintf(stderr, "%s %s %llu", i % 6 == 0 ? "\n   " : "",
+            mnemonic_name(i), (unsigned long long)mnemonic_counts[i]);
+  }
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+  Double cases = 1000000, only_case = 0, number;
+  double time_limit = 0, seconds;
+  int c, only = 0, failed = 0, i;
+  struct timespec start, now;
+
+  while ((c = getopt(argc, argv, "s:n:t:m:c:")) != -1) {
+    switch (c) {
+    case 's':
+      base_seed = strtoull(optarg, NULL, 0);
+      break;
+    case 'n':
+      cases = strtoull(optarg, NULL, 0);
+      break;
+    case 't':
+      time_limit = atof(optarg);
+      break;
+    case 'm':
+      max_steps = atoi(optarg);
+      break;
+    case 'c':
+      only_case = strtoull(optarg, NULL, 0);
+      only = 1;
+      break;
+    default:
+      fprintf(stderr,
+              "usage: %s [-s seed] [-n cases] [-t seconds] [-m steps] "
+              "[-c case] [seed.input...]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  for (i = optind; i < argc; i++) {
+    if (load_seed(argv[i]) != 0) {
+      fprintf(stderr, "Cannot open %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  reference_memory = calloc(MEMORY_SPACE, 1);
+  engine_memory = calloc(MEMORY_SPACE, 1);
+  engine = engine_create(engine_memory, 1);
+  if (engine != NULL) {
+    engine_count_blocks(engine);
+  }
+  dirty_capacity = 2 * max_steps + 1;
+  dirty = malloc(dirty_capacity * sizeof(Range));
+  if (reference_memory == NULL || engine_memory == NULL || engine == NULL ||
+      dirty == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 2;
+  }
+  exit_hook = trap_exit;
+  console_hook = keep_last_output;
+  signal(SIGSEGV, crash_handler);
+  signal(SIGBUS, crash_handler);
+  signal(SIGFPE, crash_handler);
+  signal(SIGILL, crash_handler);
+  signal(SIGABRT, crash_handler);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (number = only ? only_case : 0; number < (only ? only_case + 1 : cases);
+       number++) {
+    generate(&current, number);
+    if (only) {
+      print_case(stdout);
+    }
+    failed = run_case();
+    reset_memory();
+    cases_run++;
+    if (failed) {
+      break;
+    }
+    /* checking the clock every case would cost more than some cases */
+    if (time_limit > 0 && number % 1024 == 1023) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if (now.tv_sec - start.tv_sec + (now.tv_nsec - start.tv_nsec) / 1e9 >=
+          time_limit) {
+        break;
+      }
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  seconds = now.tv_sec - start.tv_sec + (now.tv_nsec - start.tv_nsec) / 1e9;
+  print_statistics(seconds > 0 ? seconds : 1e-9);
+  return failed;
+}
@@ -0,0 +1,229 @@
+#include "statehash.h"
+#include "tracestream.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Compares two state-hash streams written with `riscv --state-hash` and
+ * reports the first interval in which the runs diverge:
+ *
+ *   hashcmp a.hash b.hash
+ *
+ * Given the commands that wrote them, it re-runs both over that interval
+ * alone, hashing every instruction, to find the first instruction that
+ * differs, and prints what each run did there:
+ *
+ *   hashcmp -a "./riscv-old -e prog.input" -b "./riscv -e prog.input" \
+ *           a.hash b.hash
+ *
+ * The commands are given the options to add to their runs, so they must
+ * not write the streams themselves. Exits 0 if the streams match, 1 if
+ * they do not. */
+
+static FILE *open_stream(const char *name) {
+  FILE *file = trace_stream_open_read(name);
+  StateHashHeader header;
+
+  if (file == NULL) {
+    fprintf(stderr, "Cannot open %s\n", name);
+    return NULL;
+  }
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, STATEHASH_MAGIC, 4) != 0 ||
+      header.version != STATEHASH_VERSION ||
+      header.record_size != sizeof(StateHashRecord)) {
+    fprintf(stderr, "%s is not a state-hash stream\n", name);
+    fclose(file);
+    return NULL;
+  }
+  return file;
+}
+
+/* Finds the first record where a and b differ, skipping the records only
+ * one of them has if their intervals differ. Returns 0 if they match, 1
+ * if they do not, setting good to the last instruction count they agree
+ * on and bad to the count of the record that differs. */
+static int first_divergence(FILE *a, FILE *b, Double *good, Double *bad) {
+  StateHashRecord ra, rb;
+  int have_a = fread(&ra, sizeof(ra), 1, a) == 1;
+  int have_b = fread(&rb, sizeof(rb), 1, b) == 1;
+
+  *good = 0;
+  while (have_a && have_b) {
+    if (ra.instructions == rb.instructions) {
+      if (ra.hash != rb.hash) {
+        *bad = ra.instructions;
+        return 1;
+      }
+      *good = ra.instructions;
+      have_a = fread(&ra, sizeof(ra), 1, a) == 1;
+      have_b = fread(&rb, sizeof(rb), 1, b) == 1;
+    } else if (ra.instructions < rb.instructions) {
+      have_a = fread(&ra, sizeof(ra), 1, a) == 1;
+    } else {
+      have_b = fread(&rb, sizeof(rb), 1, b) == 1;
+    }
+  }
+  /* one run went on after the other ended */
+  if (have_a || have_b) {
+    *bad = have_a ? ra.instructions : rb.instructions;
+    return 1;
+  }
+  return 0;
+}
+
+static int compare_files(const char *a_name, const char *b_name, Double *good,
+                         Double *bad) {
+  FILE *a = open_stream(a_name), *b = open_stream(b_name);
+  int result;
+
+  if (a == NULL || b == NULL) {
+    exit(2);
+  }
+  result = first_divergence(a, b, good, bad);
+  fclose(a);
+  fclose(b);
+  return result;
+}
+
+static void run(const char *command, const char *options) {
+  char *line = malloc(strlen(command) + strlen(options) + 32);
+
+  sprintf(line, "%s %s >/dev/null 2>&1", command, options);
+  /* the guests exit with whatever status they like */
+  if (system(line) == -1) {
+    fprintf(stderr, "Cannot run %s\n", command);
+    exit(2);
+  }
+  free(line);
+}
+
+static char *temporary(void) {
+  char *name = strdup("/tmp/hashcmp.XXXXXX");
+  int fd = mkstemp(name);
+
+  if (fd < 0) {
+    fprintf(stderr, "Cannot create a temporary file\n");
+    exit(2);
+  }
+  close(fd);
+  return name;
+}
+
+/* Prints the delta-trace line of the instruction, see write_delta_line()
+ * in trace.c, or why there is none. */
+static void show_instruction(const char *label, const char *command,
+                             Double instruction) {
+  char *name = temporary(), options[256], *line = NULL;
+  size_t size = 0;
+  int found = 0;
+  FILE *file;
+
+  snprintf(options, sizeof(options),
+           "--trace-delta=%s --trace-from=%llu --trace-count=1", name,
+           (unsigned long long)instruction);
+  run(command, options);
+  file = fopen(name, "r");
+  while (file != NULL && getline(&line, &size, file) > 0) {
+    char *end;
+
+    /* past the initial dump and the sync line, "0000100c: ..." */
+    strtoul(line, &end, 16);
+    if (end - line == 8 && *end == ':') {
+      printf("  %s: %s", label, line);
+      found = 1;
+    }
+  }
+  if (!found) {
+    printf("  %s: (ended before it)\n", label);
+  }
+  if (file != NULL) {
+    fclose(file);
+  }
+  free(line);
+  unlink(name);
+  free(name);
+}
+
+/* Runs command writing the hash of every instruction from good up to bad
+ * to name. */
+static void hash_window(const char *command, const char *name, Double good,
+                        Double bad) {
+  char options[256];
+
+  snprintf(options, sizeof(options),
+           "--state-hash=%s --state-hash-every=1 --trace-from=%llu "
+           "--trace-to=%llu",
+           name, (unsigned long long)good, (unsigned long long)bad);
+  run(command, options);
+}
+
+/* Re-runs both commands over the instructions from good up to bad, and
+ * returns the first one after which their states differ. */
+static Double bisect(const char *command_a, const char *command_b, Double good,
+                     Double bad) {
+  char *a = temporary(), *b = temporary();
+  Double fine_good, fine_bad;
+
+  hash_window(command_a, a, good, bad);
+  hash_window(command_b, b, good, bad);
+
+  if (!compare_files(a, b, &fine_good, &fine_bad)) {
+    /* the runs are not deterministic, or not the runs that wrote the
+     * streams */
+    fine_bad = bad;
+    printf("the re-runs match between instructions %llu and %llu\n",
+           (unsigned long long)good, (unsigned long long)(bad - 1));
+  }
+  unlink(a);
+  unlink(b);
+  free(a);
+  free(b);
+  return fine_bad - 1;
+}
+
+int main(int argc, char **argv) {
+  const char *command_a = NULL, *command_b = NULL;
+  Double good, bad, instruction;
+  int c;
+
+  while ((c = getopt(argc, argv, "a:b:")) != -1) {
+    switch (c) {
+    case 'a':
+      command_a = optarg;
+      break;
+    case 'b':
+      command_b = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-a command -b command] a.hash b.hash\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (argc - optind != 2 || (command_a == NULL) != (command_b == NULL)) {
+    fprintf(stderr, "usage: %s [-a command -b command] a.hash b.hash\n",
+            argv[0]);
+    return 2;
+  }
+
+  if (!compare_files(argv[optind], argv[optind + 1], &good, &bad)) {
+    printf("%s and %s match after %llu instructions\n", argv[optind],
+           argv[optind + 1], (unsigned long long)good);
+    return 0;
+  }
+  printf("%s and %s diverge between instructions %llu and %llu\n",
+         argv[optind], argv[optind + 1], (unsigned long long)good,
+         (unsigned long long)(bad - 1));
+
+  if (command_a != NULL) {
+    instruction = bisect(command_a, command_b, good, bad);
+    printf("first differing instruction: %llu\n",
+           (unsigned long long)instruction);
+    show_instruction("a", command_a, instruction);
+    show_instruction("b", command_b, instruction);
+  }
+  return 1;
+}
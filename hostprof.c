@@ -0,0 +1,99 @@
+#include "hostprof.h"
+#include "cycles.h"
+#include "mnemonic.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int hostprof_active = 0;
+
+/* by mnemonic id; the last entry takes the mnemonics past MAX_MNEMONICS */
+static Double counts[MAX_MNEMONICS + 1], cycles[MAX_MNEMONICS + 1];
+static Double timer_cost = 0;
+static FILE *hostprof_file = NULL;
+
+void hostprof_add(Word instruction_bits, Double elapsed) {
+  int id = mnemonic_id(instruction_bits);
+
+  if (id < 0) {
+    id = MAX_MNEMONICS;
+  }
+  counts[id]++;
+  cycles[id] += elapsed;
+}
+
+/* what timing nothing costs, the least of many tries */
+static Double measure_timer_cost(void) {
+  Double least = ~0ULL;
+  int i;
+
+  for (i = 0; i < 1000; i++) {
+    Double start = read_cycles(), elapsed = read_cycles() - start;
+
+    if (elapsed < least) {
+      least = elapsed;
+    }
+  }
+  return least;
+}
+
+/* the cycles of id less the timing around each instruction */
+static double net_cycles(int id) {
+  double net = (double)cycles[id] - (double)counts[id] * timer_cost;
+
+  return net > 0 ? net : 0;
+}
+
+static int by_cycles(const void *a, const void *b) {
+  double x = net_cycles(*(const int *)a), y = net_cycles(*(const int *)b);
+
+  return (x < y) - (x > y);
+}
+
+static void hostprof_close(void) {
+  int order[MAX_MNEMONICS + 1], rows = 0, i;
+  Double total_count = 0;
+  double total_cycles = 0;
+
+  hostprof_active = 0;
+  for (i = 0; i <= MAX_MNEMONICS; i++) {
+    if (counts[i] != 0) {
+      order[rows++] = i;
+      total_count += counts[i];
+      total_cycles += net_cycles(i);
+    }
+  }
+  qsort(order, rows, sizeof(int), by_cycles);
+
+  fflush(stdout);
+  fprintf(hostprof_file,
+          "host profile: %llu instructions, %.0f cycles, %llu cycles of "
+          "timing subtracted from each\n",
+          (unsigned long long)total_count, total_cycles,
+          (unsigned long long)timer_cost);
+  fprintf(hostprof_file, "%-20s %12s %7s %14s %7s %9s\n", "mnemonic", "count",
+          "%", "cycles", "%", "cycles/i");
+  for (i = 0; i < rows; i++) {
+    int id = order[i];
+
+    fprintf(hostprof_file, "%-20s %12llu %6.2f%% %14.0f %6.2f%% %9.2f\n",
+            id == MAX_MNEMONICS ? "(other)" : mnemonic_name(id),
+            (unsigned long long)counts[id], 100.0 * counts[id] / total_count,
+            net_cycles(id),
+            total_cycles > 0 ? 100 * net_cycles(id) / total_cycles : 0,
+            net_cycles(id) / counts[id]);
+  }
+  if (hostprof_file != stderr) {
+    fclose(hostprof_file);
+  }
+}
+
+int hostprof_open(const char *filename) {
+  hostprof_file = filename != NULL ? fopen(filename, "w") : stderr;
+  if (hostprof_file == NULL) {
+    return -1;
+  }
+  timer_cost = measure_timer_cost();
+  hostprof_active = 1;
+  atexit(hostprof_close);
+  return 0;
+}
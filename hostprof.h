@@ -0,0 +1,18 @@
+#ifndef HOSTPROF_H
+#define HOSTPROF_H
+
+#include "types.h"
+
+/* Host-cost profile: the host cycles (see cycles.h) each executed
+   instruction took, summed by mnemonic and printed at exit as the count,
+   the total and the cycles per instruction of each, most expensive first.
+   The instruction that ends the run never returns and is not counted. */
+
+/* set while profiling, see execute() in riscv.c */
+extern int hostprof_active;
+
+/* the table goes to filename, or to stderr if it is NULL */
+int hostprof_open(const char *filename);
+void hostprof_add(Word instruction_bits, Double cycles);
+
+#endif
@@ -0,0 +1,74 @@
+#include "memtrace.h"
+#include "tracestream.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Records are collected in a buffer of our own and written a buffer at a
+ * time, which keeps the cost per access down to a few stores. */
+#define MEMTRACE_BUFFER_RECORDS 4096
+
+static FILE *memtrace_file = NULL;
+static int memtrace_fetches = 0;
+static MemTraceRecord buffer[MEMTRACE_BUFFER_RECORDS];
+static int buffered = 0;
+
+static void flush_buffer(void) {
+  fwrite(buffer, sizeof(buffer[0]), buffered, memtrace_file);
+  buffered = 0;
+}
+
+static void append(Word pc, Word address, Word value, int width, int kind) {
+  MemTraceRecord *record = &buffer[buffered];
+
+  record->pc = pc;
+  record->addr = address;
+  record->value = value;
+  record->width = width;
+  record->kind = kind;
+  record->reserved = 0;
+  if (++buffered == MEMTRACE_BUFFER_RECORDS) {
+    flush_buffer();
+  }
+}
+
+int memtrace_open(const char *filename, int codec, int fetches) {
+  MemTraceHeader header;
+
+  memtrace_file = trace_stream_open_write(filename, codec);
+  if (memtrace_file == NULL) {
+    return -1;
+  }
+  memtrace_fetches = fetches;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MEMTRACE_MAGIC, 4);
+  header.version = MEMTRACE_VERSION;
+  header.record_size = sizeof(MemTraceRecord);
+  fwrite(&header, sizeof(header), 1, memtrace_file);
+  return 0;
+}
+
+void memtrace_fetch(Word pc, Word instruction_bits) {
+  if (memtrace_fetches) {
+    append(pc, pc, instruction_bits, LENGTH_WORD, MEMTRACE_FETCH);
+  }
+}
+
+/* value is what load() returned or store() was given; only the bytes
+ * actually accessed are kept. */
+void memtrace_access(Word pc, Address address, Alignment alignment,
+                     Word value, int kind) {
+  if (alignment != LENGTH_WORD) {
+    value &= (1U << (8 * alignment)) - 1;
+  }
+  append(pc, address, value, alignment, kind);
+}
+
+void memtrace_close(void) {
+  if (memtrace_file == NULL) {
+    return;
+  }
+  flush_buffer();
+  fclose(memtrace_file);
+  memtrace_file = NULL;
+}
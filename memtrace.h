@@ -0,0 +1,42 @@
+#ifndef MEMTRACE_H
+#define MEMTRACE_H
+
+#include "types.h"
+
+/* Memory-access traces are a MemTraceHeader followed by one MemTraceRecord
+   per load and store, and optionally per instruction fetch, in the order
+   the simulator performs them. Everything is written in host
+   (little-endian) byte order. They feed offline cache and prefetcher
+   models; `trace2text` prints them as text. */
+#define MEMTRACE_MAGIC "RVTM"
+#define MEMTRACE_VERSION 1
+
+/* MemTraceRecord.kind */
+#define MEMTRACE_READ 0
+#define MEMTRACE_WRITE 1
+#define MEMTRACE_FETCH 2
+
+typedef struct {
+    char magic[4];
+    Half version;
+    Half record_size;
+} MemTraceHeader;
+
+typedef struct {
+    Word pc;
+    Word addr;  /* the pc itself for MEMTRACE_FETCH */
+    Word value; /* the bytes in memory, or the instruction fetched */
+    Byte width; /* in bytes */
+    Byte kind;
+    Half reserved;
+} MemTraceRecord;
+
+/* codec is one of the TRACE_CODEC_* values in tracestream.h; fetches adds
+   a MEMTRACE_FETCH record for every instruction */
+int memtrace_open(const char *filename, int codec, int fetches);
+void memtrace_fetch(Word pc, Word instruction_bits);
+void memtrace_access(Word pc, Address address, Alignment alignment,
+                     Word value, int kind);
+void memtrace_close(void);
+
+#endif
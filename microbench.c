@@ -0,0 +1,389 @@
+#include "cycles.h"
+#include "riscv.h"
+#include "utils.h"
+#include <getopt.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Times the simulator's primitives one at a time, in cycles per call:
+ *
+ *   microbench [-r repetitions] [-w warmups] [-n instructions] [prog.input...]
+ *
+ * The instructions they are called on are the first -n instructions each
+ * program executes (by default the kernels in code/bench), recorded with
+ * the values of their source registers, so the mix of opcodes, operands
+ * and addresses is the one real runs see. Each primitive is called once
+ * per recorded instruction it applies to, per repetition, after the
+ * warmups; the fastest and the median repetition are reported, less the
+ * cost of the loop around the calls. Built with the simulator's flags. */
+
+/* see part2.c */
+void execute_rtype(Instruction, Processor *);
+void execute_itype_except_load(Instruction, Processor *);
+void execute_branch(Instruction, Processor *);
+void execute_jal(Instruction, Processor *);
+void execute_load(Instruction, Processor *, Byte *);
+void execute_store(Instruction, Processor *, Byte *);
+void execute_ecall(Processor *, Byte *);
+void execute_lui(Instruction, Processor *);
+
+#define CODE_START 0x1000
+
+/* an executed instruction, with its source registers as they were */
+typedef struct {
+  Word bits;
+  Byte rs1, rs2;
+  Word rs1_value, rs2_value;
+} Op;
+
+typedef struct {
+  Op *ops;
+  int count, capacity;
+} Pool;
+
+enum {
+  POOL_ALL, POOL_RTYPE, POOL_ITYPE, POOL_LOAD, POOL_STORE, POOL_BRANCH,
+  POOL_JAL, POOL_LUI, POOL_ECALL, POOLS
+};
+
+static Pool pools[POOLS];
+static Byte *memory;
+static Processor processor;
+static volatile Word sink;
+
+static jmp_buf trap;
+
+static void trap_exit(int status) { longjmp(trap, 1); }
+
+static int swallow_output(const char *text, int length) { return 1; }
+
+/* ---- recording the mix ---- */
+
+static void add_op(Pool *pool, const Op *op) {
+  if (pool->count == pool->capacity) {
+    pool->capacity = pool->capacity ? 2 * pool->capacity : 1024;
+    pool->ops = realloc(pool->ops, pool->capacity * sizeof(Op));
+  }
+  pool->ops[pool->count++] = *op;
+}
+
+static int pool_of(Word bits) {
+  switch (bits & 0x7F) {
+  case 0x33:
+    return POOL_RTYPE;
+  case 0x13:
+    return POOL_ITYPE;
+  case 0x03:
+    return POOL_LOAD;
+  case 0x23:
+    return POOL_STORE;
+  case 0x63:
+    return POOL_BRANCH;
+  case 0x6F:
+    return POOL_JAL;
+  case 0x37:
+    return POOL_LUI;
+  default:
+    return POOL_ECALL;
+  }
+}
+
+/* Runs filename as `riscv -e -a 0,7fffffff` would for up to limit
+ * instructions, adding each one that completes to the pools. */
+static int record(const char *filename, int limit) {
+  FILE *file = fopen(filename, "r");
+  char line[64];
+  Address address = CODE_START;
+  volatile int executed = 0;
+
+  if (file == NULL) {
+    return -1;
+  }
+  memset(memory, 0, MEMORY_SPACE);
+  while (fgets(line, sizeof(line), file) != NULL &&
+         address <= MEMORY_SPACE - 4) {
+    Word word = strtoul(line, NULL, 16);
+    int i;
+
+    for (i = 0; i < 4; i++) {
+      memory[address + i] = word >> (8 * i);
+    }
+    address += 4;
+  }
+  fclose(file);
+
+  memset(&processor, 0, sizeof(processor));
+  processor.R[2] = 0xEFFFF;
+  processor.R[3] = 0x3000;
+  processor.R[11] = 0x7FFFFFFF;
+  processor.PC = CODE_START;
+  if (setjmp(trap) != 0) {
+    return 0;
+  }
+  while (executed < limit) {
+    Word bits = load(memory, processor.PC, LENGTH_WORD);
+    Instruction instruction = parse_instruction(bits);
+    Op op = {bits, instruction.rtype.rs1, instruction.rtype.rs2,
+             processor.R[instruction.rtype.rs1],
+             processor.R[instruction.rtype.rs2]};
+
+    /* ecalls read a0 and a1 */
+    if (instruction.opcode == 0x73) {
+      op.rs1 = 10;
+      op.rs2 = 11;
+      op.rs1_value = processor.R[10];
+      op.rs2_value = processor.R[11];
+    }
+    execute_instruction(bits, &processor, memory);
+    processor.R[0] = 0;
+    add_op(&pools[POOL_ALL], &op);
+    add_op(&pools[pool_of(bits)], &op);
+    executed++;
+  }
+  return 0;
+}
+
+/* ---- the benchmarks ---- */
+
+/* sets the source registers as they were when op was recorded */
+static inline Instruction prepare(const Op *op) {
+  processor.R[op->rs1] = op->rs1_value;
+  processor.R[op->rs2] = op->rs2_value;
+  return parse_instruction(op->bits);
+}
+
+static void run_overhead(const Op *ops, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    sink += prepare(&ops[i]).bits;
+  }
+}
+
+static void run_parse_instruction(const Op *ops, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    prepare(&ops[i]);
+    sink += parse_instruction(ops[i].bits).opcode;
+  }
+}
+
+static void run_sign_extend_number(const Op *ops, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    prepare(&ops[i]);
+    sink += sign_extend_number(ops[i].bits >> 20, 12);
+  }
+}
+
+static void run_get_branch_offset(const Op *ops, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    sink += get_branch_offset(prepare(&ops[i]));
+  }
+}
+
+static void run_get_jump_offset(const Op *ops, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    sink += get_jump_offset(prepare(&ops[i]));
+  }
+}
+
+static void run_get_store_offset(const Op *ops, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    sink += get_store_offset(prepare(&ops[i]));
+  }
+}
+
+static const Alignment widths[] = {LENGTH_BYTE, LENGTH_HALF_WORD,
+                                   LENGTH_WORD, LENGTH_WORD};
+
+static void run_load(const Op *ops, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    Instruction instruction = prepare(&ops[i]);
+
+    sink += load(memory,
+                 ops[i].rs1_value +
+                     sign_extend_number(instruction.itype.imm, 12),
+                 widths[instruction.itype.funct3 & 3]);
+  }
+}
+
+static void run_store(const Op *ops, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    Instruction instruction = prepare(&ops[i]);
+
+    store(memory, ops[i].rs1_value + get_store_offset(instruction),
+          widths[instruction.stype.funct3 & 3], ops[i].rs2_value);
+  }
+}
+
+static void run_execute_instruction(const Op *ops, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    prepare(&ops[i]);
+    execute_instruction(ops[i].bits, &processor, memory);
+  }
+}
+
+#define RUN_HANDLER(name, call)                                                \
+  static void run_##name(const Op *ops, int n) {                               \
+    int i;                                                                     \
+                                                                               \
+    for (i = 0; i < n; i++) {                                                  \
+      Instruction instruction = prepare(&ops[i]);                              \
+                                                                               \
+      call;                                                                    \
+    }                                                                          \
+  }
+
+RUN_HANDLER(execute_rtype, execute_rtype(instruction, &processor))
+RUN_HANDLER(execute_itype_except_load,
+            execute_itype_except_load(instruction, &processor))
+RUN_HANDLER(execute_load, execute_load(instruction, &processor, memory))
+RUN_HANDLER(execute_store, execute_store(instruction, &processor, memory))
+RUN_HANDLER(execute_branch, execute_branch(instruction, &processor))
+RUN_HANDLER(execute_jal, execute_jal(instruction, &processor))
+RUN_HANDLER(execute_lui, execute_lui(instruction, &processor))
+RUN_HANDLER(execute_ecall, (void)instruction;
+            execute_ecall(&processor, memory))
+
+typedef struct {
+  const char *name;
+  void (*run)(const Op *, int);
+  int pool;
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"parse_instruction", run_parse_instruction, POOL_ALL},
+    {"sign_extend_number", run_sign_extend_number, POOL_ITYPE},
+    {"get_branch_offset", run_get_branch_offset, POOL_BRANCH},
+    {"get_jump_offset", run_get_jump_offset, POOL_JAL},
+    {"get_store_offset", run_get_store_offset, POOL_STORE},
+    {"load", run_load, POOL_LOAD},
+    {"store", run_store, POOL_STORE},
+    {"execute_rtype", run_execute_rtype, POOL_RTYPE},
+    {"execute_itype_except_load", run_execute_itype_except_load, POOL_ITYPE},
+    {"execute_load", run_execute_load, POOL_LOAD},
+    {"execute_store", run_execute_store, POOL_STORE},
+    {"execute_branch", run_execute_branch, POOL_BRANCH},
+    {"execute_jal", run_execute_jal, POOL_JAL},
+    {"execute_lui", run_execute_lui, POOL_LUI},
+    {"execute_ecall", run_execute_ecall, POOL_ECALL},
+    {"execute_instruction", run_execute_instruction, POOL_ALL},
+};
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* Cycles per op of the fastest and the median repetition. */
+static void measure(const Benchmark *benchmark, int warmups, int repetitions,
+                    double *fastest, double *median) {
+  const Pool *pool = &pools[benchmark->pool];
+  double *samples = malloc(repetitions * sizeof(double));
+  int i;
+
+  for (i = 0; i < warmups; i++) {
+    benchmark->run(pool->ops, pool->count);
+  }
+  for (i = 0; i < repetitions; i++) {
+    Double start = read_cycles();
+
+    benchmark->run(pool->ops, pool->count);
+    samples[i] = (double)(read_cycles() - start) / pool->count;
+  }
+  qsort(samples, repetitions, sizeof(double), compare_doubles);
+  *fastest = samples[0];
+  *median = samples[repetitions / 2];
+  free(samples);
+}
+
+int main(int argc, char **argv) {
+  static const char *const default_programs[] = {
+      "code/bench/multiply.input", "code/bench/mac.input",
+      "code/bench/random.input",   "code/bench/stream.input",
+      "code/bench/branch.input",   NULL};
+  Benchmark overhead_benchmark = {"(loop)", run_overhead, POOL_ALL};
+  int repetitions = 20, warmups = 2, limit = 65536, c, i;
+  double overhead_fast, overhead_median, hz;
+
+  while ((c = getopt(argc, argv, "r:w:n:")) != -1) {
+    switch (c) {
+    case 'r':
+      repetitions = atoi(optarg);
+      break;
+    case 'w':
+      warmups = atoi(optarg);
+      break;
+    case 'n':
+      limit = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr,
+              "usage: %s [-r repetitions] [-w warmups] [-n instructions] "
+              "[prog.input...]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (repetitions < 1) {
+    repetitions = 1;
+  }
+
+  memory = calloc(MEMORY_SPACE, 1);
+  exit_hook = trap_exit;
+  console_hook = swallow_output;
+  for (i = optind; i < argc; i++) {
+    if (record(argv[i], limit) != 0) {
+      fprintf(stderr, "Cannot open %s\n", argv[i]);
+      return 2;
+    }
+  }
+  for (i = 0; optind == argc && default_programs[i] != NULL; i++) {
+    if (record(default_programs[i], limit) != 0) {
+      fprintf(stderr, "Cannot open %s\n", default_programs[i]);
+      return 2;
+    }
+  }
+
+  hz = cycles_per_second();
+  measure(&overhead_benchmark, warmups, repetitions, &overhead_fast,
+          &overhead_median);
+  printf("%llu instructions recorded; %.0f MHz cycle counter; loop overhead "
+         "%.2f cycles/op subtracted\n\n",
+         (unsigned long long)pools[POOL_ALL].count, hz / 1e6, overhead_fast);
+  printf("%-26s %9s %12s %12s %9s\n", "primitive", "calls", "cycles/op",
+         "median", "ns/op");
+  for (i = 0; i < (int)(sizeof(benchmarks) / sizeof(benchmarks[0])); i++) {
+    double fastest, median;
+
+    if (pools[benchmarks[i].pool].count == 0) {
+      printf("%-26s %9s\n", benchmarks[i].name, "-");
+      continue;
+    }
+    measure(&benchmarks[i], warmups, repetitions, &fastest, &median);
+    fastest -= overhead_fast;
+    median -= overhead_median;
+    printf("%-26s %9d %12.2f %12.2f %9.2f\n", benchmarks[i].name,
+           pools[benchmarks[i].pool].count, fastest, median,
+           fastest / hz * 1e9);
+  }
+  return 0;
+}
@@ -0,0 +1,47 @@
+#include "mnemonic.h"
+#include "riscv.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MNEMONIC_KEY(bits) (((bits) & 0x7F) | ((bits) >> 5 & 0x380) | \
+                            ((bits) >> 15 & 0x1FC00))
+
+/* id + 1 by key, 0 until the key is first seen */
+static Byte id_by_key[1 << 17];
+static char names[MAX_MNEMONICS][24];
+static int seen = 0;
+
+int mnemonic_id(Word bits) {
+  int key = MNEMONIC_KEY(bits), id = id_by_key[key] - 1, cache = 1;
+  char line[DISASM_LINE_SIZE];
+
+  if (id >= 0) {
+    return id;
+  }
+  /* which counter a csr instruction reads is beyond the key, so those
+   * are looked up every time; they are rare */
+  if ((bits & 0x7F) == 0x73 && (bits >> 12 & 0x7) != 0) {
+    cache = 0;
+  }
+  disassemble_instruction(line, bits);
+  line[strcspn(line, "\t\n:")] = '\0';
+  for (id = 0; id < seen; id++) {
+    if (strcmp(names[id], line) == 0) {
+      break;
+    }
+  }
+  if (id == MAX_MNEMONICS) {
+    return -1;
+  }
+  if (id == seen) {
+    snprintf(names[seen++], sizeof(names[0]), "%.23s", line);
+  }
+  if (cache) {
+    id_by_key[key] = id + 1;
+  }
+  return id;
+}
+
+const char *mnemonic_name(int id) { return names[id]; }
+
+int mnemonics_seen(void) { return seen; }
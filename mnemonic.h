@@ -0,0 +1,19 @@
+#ifndef MNEMONIC_H
+#define MNEMONIC_H
+
+#include "types.h"
+
+/* Small numbers for the mnemonics of executed instructions, handed out in
+   the order they are first seen, for the profilers to count by. The
+   mnemonic depends on the opcode, funct3 and funct7 alone, but for the
+   CSR counter reads, so after the first instruction with a given
+   combination the lookup is one load.
+   Instructions part1.c does not know share "Invalid Instruction". */
+#define MAX_MNEMONICS 64
+
+/* -1 once MAX_MNEMONICS different mnemonics have been seen */
+int mnemonic_id(Word bits);
+const char *mnemonic_name(int id);
+int mnemonics_seen(void);
+
+#endif
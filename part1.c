@@ -1,268 +1,469 @@
+#include <pthread.h>
 #include <stdio.h> // for stderr
 #include <stdlib.h> // for exit()
+#include <string.h>
+#include <unistd.h>
 #include "types.h"
 #include "utils.h"
+#include "riscv.h"
 
-void print_rtype(char *, Instruction);
-void print_itype_except_load(char *, Instruction, int);
-void print_load(char *, Instruction);
-void print_store(char *, Instruction);
-void print_branch(char *, Instruction);
-void print_lui(Instruction);
-void print_jal(Instruction);
-void print_ecall(Instruction);
-void write_rtype(Instruction);
-void write_itype_except_load(Instruction); 
-void write_load(Instruction);
-void write_store(Instruction);
-void write_branch(Instruction);
+void print_rtype(char *, char *, Instruction);
+void print_itype_except_load(char *, char *, Instruction, int);
+void print_load(char *, char *, Instruction);
+void print_store(char *, char *, Instruction);
+void print_branch(char *, char *, Instruction);
+void print_lui(char *, Instruction);
+void print_jal(char *, Instruction);
+void print_ecall(char *, Instruction);
+void print_csr(char *, Instruction);
+void print_invalid(char *, Instruction);
+void write_rtype(char *, Instruction);
+void write_itype_except_load(char *, Instruction); 
+void write_load(char *, Instruction);
+void write_store(char *, Instruction);
+void write_branch(char *, Instruction);
 
 
 void decode_instruction(uint32_t instruction_bits) {
+    char line[DISASM_LINE_SIZE];
+
+    disassemble_instruction(line, instruction_bits);
+    fputs(line, stdout);
+}
+
+/* -t prints the same few static instructions over and over, so their
+   lines are formatted once and kept in a direct-mapped cache keyed by pc.
+   An entry also keeps the instruction it was formatted from and is only
+   used while that still matches, which covers code being overwritten.
+   Each thread has a cache of its own. */
+#define DISASM_CACHE_ENTRIES 8192
+
+typedef struct {
+    Address pc;
+    uint32_t bits;
+    int length; /* 0 for an empty entry */
+    char line[10 + DISASM_LINE_SIZE];
+} DisasmCacheEntry;
+
+static __thread DisasmCacheEntry *disasm_cache = NULL;
+
+/* Returns the line -t prints for the instruction at pc, "pc: disassembly"
+   and a newline, and sets length to its length. */
+const char *disassembly_line(Address pc, uint32_t instruction_bits, int *length) {
+    DisasmCacheEntry *entry;
+
+    if (disasm_cache == NULL) {
+        disasm_cache = calloc(DISASM_CACHE_ENTRIES, sizeof(*disasm_cache));
+        if (disasm_cache == NULL) {
+            fprintf(stderr, "Out of memory disassembling\n");
+            exit(-1);
+        }
+    }
+    entry = &disasm_cache[(pc >> 2) & (DISASM_CACHE_ENTRIES - 1)];
+    if (entry->length == 0 || entry->pc != pc || entry->bits != instruction_bits) {
+        entry->pc = pc;
+        entry->bits = instruction_bits;
+        sprintf(entry->line, "%08x: ", pc);
+        disassemble_instruction(entry->line + 10, instruction_bits);
+        entry->length = 10 + strlen(entry->line + 10);
+    }
+    *length = entry->length;
+    return entry->line;
+}
+
+/* the smallest share of an image worth a thread of its own */
+#define DISASM_CHUNK_MIN 8192
+
+static uint32_t image_word(const Byte *memory, Address address) {
+    const Byte *bytes = memory + address;
+
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+typedef struct {
+    const Byte *memory;
+    Address start;
+    int count;
+    char *text;
+    size_t length;
+    pthread_t worker;
+    int threaded;
+} DisasmChunk;
+
+/* Formats a chunk of an image as `-d` prints it into a buffer of its own. */
+static void *disassemble_chunk(void *arg) {
+    DisasmChunk *chunk = arg;
+    char *p;
+    int i;
+
+    /* "%08x: " and the line */
+    p = chunk->text = malloc((size_t)chunk->count * (10 + DISASM_LINE_SIZE) + 1);
+    if (p == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < chunk->count; i++) {
+        Address address = chunk->start + 4 * i;
+
+        p += sprintf(p, "%08x: ", address);
+        disassemble_instruction(p, image_word(chunk->memory, address));
+        p += strlen(p);
+    }
+    chunk->length = p - chunk->text;
+    return NULL;
+}
+
+/* Prints the disassembly of the count instructions at start in memory to
+   out, split over up to threads threads (0 for one per CPU). The output is
+   the same as calling decode_instruction() on each in turn. */
+void disassemble_image(FILE *out, const Byte *memory, Address start, int count,
+                       int threads) {
+    DisasmChunk *chunks;
+    int i, per_chunk, length;
+
+    if (count <= DISASM_CACHE_ENTRIES) {
+        /* one thread's work, and it all fits in the cache: a run after the
+           disassembly (--disasm-out) then finds every line formatted */
+        for (i = 0; i < count; i++) {
+            Address address = start + 4 * i;
+            const char *line = disassembly_line(address, image_word(memory, address),
+                                                &length);
+
+            fwrite(line, 1, length, out);
+        }
+        return;
+    }
+    if (threads <= 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > (count + DISASM_CHUNK_MIN - 1) / DISASM_CHUNK_MIN) {
+        threads = (count + DISASM_CHUNK_MIN - 1) / DISASM_CHUNK_MIN;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    per_chunk = (count + threads - 1) / threads;
+
+    chunks = calloc(threads, sizeof(*chunks));
+    for (i = 0; i < threads; i++) {
+        int first = i * per_chunk;
+
+        chunks[i].memory = memory;
+        chunks[i].start = start + 4 * first;
+        chunks[i].count = count - first < per_chunk ? count - first : per_chunk;
+        if (chunks[i].count < 0) {
+            chunks[i].count = 0;
+        }
+        /* the calling thread takes the first chunk itself */
+        chunks[i].threaded = i > 0 && pthread_create(&chunks[i].worker, NULL,
+                                                     disassemble_chunk,
+                                                     &chunks[i]) == 0;
+    }
+    for (i = 0; i < threads; i++) {
+        if (chunks[i].threaded) {
+            pthread_join(chunks[i].worker, NULL);
+        } else {
+            disassemble_chunk(&chunks[i]);
+        }
+        if (chunks[i].text == NULL) {
+            fprintf(stderr, "Out of memory disassembling\n");
+            exit(-1);
+        }
+        fwrite(chunks[i].text, 1, chunks[i].length, out);
+        free(chunks[i].text);
+    }
+    free(chunks);
+}
+
+/* Formats the disassembly of instruction_bits, including the trailing
+   newline, into line, which must hold DISASM_LINE_SIZE bytes. */
+void disassemble_instruction(char *line, uint32_t instruction_bits) {
     Instruction instruction = parse_instruction(instruction_bits);
     switch(instruction.opcode) {
         case 0x33:
-            write_rtype(instruction);
+            write_rtype(line, instruction);
             break;
         case 0x13:
-            write_itype_except_load(instruction);
+            write_itype_except_load(line, instruction);
             break;
         case 0x3:
-            write_load(instruction);
+            write_load(line, instruction);
             break;
         case 0x23:
-            write_store(instruction);
+            write_store(line, instruction);
             break;
         case 0x63:
-            write_branch(instruction);
+            write_branch(line, instruction);
             break;
         case 0x37:
-            print_lui(instruction);
+            print_lui(line, instruction);
             break;
         case 0x6F:
-            print_jal(instruction);
+            print_jal(line, instruction);
             break;
         case 0x73:
-            print_ecall(instruction);
+            if (instruction.itype.funct3 == 0x0) {
+                print_ecall(line, instruction);
+            } else {
+                print_csr(line, instruction);
+            }
             break;
         default: // undefined opcode
-            handle_invalid_instruction(instruction);
+            print_invalid(line, instruction);
             break;
     }
 }
 
-void write_rtype(Instruction instruction) {
+void write_rtype(char *line, Instruction instruction) {
     switch (instruction.rtype.funct3) {
         case 0x0:
             switch (instruction.rtype.funct7) {
                 case 0x0:
-                    print_rtype("add", instruction);
+                    print_rtype(line, "add", instruction);
                     break;
                 case 0x1:
-                    print_rtype("mul", instruction);
+                    print_rtype(line, "mul", instruction);
                     break;
                 case 0x20:
-                    print_rtype("sub", instruction);
+                    print_rtype(line, "sub", instruction);
                     break;
                 default:
-                    handle_invalid_instruction(instruction);
+                    print_invalid(line, instruction);
                 break;      
             }
             break;
         case 0x1:
             switch (instruction.rtype.funct7) {
                 case 0x0:
-                print_rtype("sll", instruction);
+                print_rtype(line, "sll", instruction);
                 break;
                 case 0x1:
-                print_rtype("mulh", instruction);
+                print_rtype(line, "mulh", instruction);
                 break;
                 default:
-                handle_invalid_instruction(instruction);
+                print_invalid(line, instruction);
                 break;
             }
             break;
         case 0x2:
-            print_rtype("slt", instruction);
+            print_rtype(line, "slt", instruction);
             break;
         case 0x4:
             switch (instruction.rtype.funct7) {
                 case 0x0:   
-                print_rtype("xor", instruction);
+                print_rtype(line, "xor", instruction);
                 break;
                 case 0x1:
-                print_rtype("div", instruction);
+                print_rtype(line, "div", instruction);
                 break;
                 default:
-                handle_invalid_instruction(instruction);
+                print_invalid(line, instruction);
                 break;
             }
             break;
         case 0x5:
             switch (instruction.rtype.funct7) {
                 case 0x0:
-                print_rtype("srl", instruction);
+                print_rtype(line, "srl", instruction);
                 break;
                 case 0x20:
-                print_rtype("sra", instruction);
+                print_rtype(line, "sra", instruction);
                 break;
                 default:
-                handle_invalid_instruction(instruction);
+                print_invalid(line, instruction);
                 break;
             }
             break;
         case 0x6:
             switch (instruction.rtype.funct7) {
                 case 0x0:
-                print_rtype("or", instruction);
+                print_rtype(line, "or", instruction);
                 break;
                 case 0x1:
-                print_rtype("rem", instruction);
+                print_rtype(line, "rem", instruction);
                 break;
                 default:
-                handle_invalid_instruction(instruction);
+                print_invalid(line, instruction);
                 break;
             }
             break;
         case 0x7:
-            print_rtype("and", instruction);
+            print_rtype(line, "and", instruction);
             break;
         default:
-            handle_invalid_instruction(instruction);
+            print_invalid(line, instruction);
         break;
     }
 }
 
-void write_itype_except_load(Instruction instruction) {
+void write_itype_except_load(char *line, Instruction instruction) {
     int shiftOp;
     switch (instruction.itype.funct3) {
         case 0x0:
-            print_itype_except_load("addi", instruction, instruction.itype.imm);
+            print_itype_except_load(line, "addi", instruction, instruction.itype.imm);
             break;
         case 0x1:
-            print_itype_except_load("slli", instruction, instruction.itype.imm);
+            print_itype_except_load(line, "slli", instruction, instruction.itype.imm);
             break;
         case 0x2:
-            print_itype_except_load("slti", instruction, instruction.itype.imm);
+            print_itype_except_load(line, "slti", instruction, instruction.itype.imm);
             break;
         case 0x4:
-            print_itype_except_load("xori", instruction, instruction.itype.imm);
+            print_itype_except_load(line, "xori", instruction, instruction.itype.imm);
             break;
         case 0x5:
             shiftOp = instruction.itype.imm >> 10;
             switch(shiftOp) {
                 case 0x0:
-                    print_itype_except_load("srli", instruction, instruction.itype.imm & 0x1F);
+                    print_itype_except_load(line, "srli", instruction, instruction.itype.imm & 0x1F);
                     break;
                 case 0x1:
-                    print_itype_except_load("srai", instruction, instruction.itype.imm & 0x1F);
+                    print_itype_except_load(line, "srai", instruction, instruction.itype.imm & 0x1F);
                     break;
                 default:
-                    handle_invalid_instruction(instruction);
+                    print_invalid(line, instruction);
                     break;
             }
             break;
         case 0x6:
-            print_itype_except_load("ori", instruction, instruction.itype.imm);
+            print_itype_except_load(line, "ori", instruction, instruction.itype.imm);
             break;
         case 0x7:
-            print_itype_except_load("andi", instruction, instruction.itype.imm);
+            print_itype_except_load(line, "andi", instruction, instruction.itype.imm);
             break;
         default:
-            handle_invalid_instruction(instruction);
+            print_invalid(line, instruction);
             break;  
     }
 }
 
-void write_load(Instruction instruction) {
+void write_load(char *line, Instruction instruction) {
     switch (instruction.itype.funct3) {
         case 0x0:
-            print_load("lb", instruction);
+            print_load(line, "lb", instruction);
             break;
         case 0x1:
-            print_load("lh", instruction);
+            print_load(line, "lh", instruction);
             break;
         case 0x2:
-            print_load("lw", instruction);
+            print_load(line, "lw", instruction);
             break;
         default:
-            handle_invalid_instruction(instruction);
+            print_invalid(line, instruction);
             break;
     }
 }
 
-void write_store(Instruction instruction) {
+void write_store(char *line, Instruction instruction) {
     switch (instruction.stype.funct3) {
         case 0x0:
-            print_store("sb", instruction);
+            print_store(line, "sb", instruction);
             break;
         case 0x1:
-            print_store("sh", instruction);
+            print_store(line, "sh", instruction);
             break;
         case 0x2:
-            print_store("sw", instruction);
+            print_store(line, "sw", instruction);
             break;
         default:
-            handle_invalid_instruction(instruction);
+            print_invalid(line, instruction);
             break;
     }
 }
 
-void write_branch(Instruction instruction) {
+void write_branch(char *line, Instruction instruction) {
     switch (instruction.sbtype.funct3) {
         case 0x0:
-            print_branch("beq", instruction);
+            print_branch(line, "beq", instruction);
             break;
         case 0x1:
-            print_branch("bne", instruction);
+            print_branch(line, "bne", instruction);
             break;
         case 0x4:
-            print_branch("blt", instruction);
+            print_branch(line, "blt", instruction);
             break;
         case 0x5:
-            print_branch("bge", instruction);
+            print_branch(line, "bge", instruction);
             break;
         default:
-            handle_invalid_instruction(instruction);
+            print_invalid(line, instruction);
             break;
     }
 }
 
-void print_lui(Instruction instruction) {
-    printf(LUI_FORMAT, instruction.utype.rd, instruction.utype.imm);
+void print_lui(char *line, Instruction instruction) {
+    snprintf(line, DISASM_LINE_SIZE, LUI_FORMAT, instruction.utype.rd, instruction.utype.imm);
 }
 
-void print_jal(Instruction instruction) {
+void print_jal(char *line, Instruction instruction) {
     int offset = get_jump_offset(instruction);
-    printf(JAL_FORMAT, instruction.ujtype.rd, offset);
+    snprintf(line, DISASM_LINE_SIZE, JAL_FORMAT, instruction.ujtype.rd, offset);
 }
 
-void print_ecall(Instruction instruction) {
-    printf(ECALL_FORMAT);
+void print_ecall(char *line, Instruction instruction) {
+    snprintf(line, DISASM_LINE_SIZE, ECALL_FORMAT);
+}
+
+void print_csr(char *line, Instruction instruction) {
+    static char *const names[8] = {NULL, "csrrw", "csrrs", "csrrc",
+                                   NULL, "csrrwi", "csrrsi", "csrrci"};
+    static char *const counters[3] = {"cycle", "time", "instret"};
+    static char *const high_counters[3] = {"cycleh", "timeh", "instreth"};
+    unsigned int csr = instruction.itype.imm;
+    char *name = names[instruction.itype.funct3], *csr_name = NULL;
+    char number[8];
+
+    if (csr >= 0xC00 && csr <= 0xC02) {
+        csr_name = counters[csr - 0xC00];
+    } else if (csr >= 0xC80 && csr <= 0xC82) {
+        csr_name = high_counters[csr - 0xC80];
+    }
+    if (name == NULL) {
+        print_invalid(line, instruction);
+    } else if (csr_name != NULL && instruction.itype.funct3 == 0x2 &&
+               instruction.itype.rs1 == 0) {
+        // rdcycle, rdtime, rdinstret and their high halves
+        char pseudo[16];
+
+        snprintf(pseudo, sizeof(pseudo), "rd%s", csr_name);
+        snprintf(line, DISASM_LINE_SIZE, COUNTER_FORMAT, pseudo,
+                 instruction.itype.rd);
+    } else {
+        if (csr_name == NULL) {
+            snprintf(number, sizeof(number), "0x%03x", csr);
+            csr_name = number;
+        }
+        snprintf(line, DISASM_LINE_SIZE,
+                 instruction.itype.funct3 & 0x4 ? CSRI_FORMAT : CSR_FORMAT,
+                 name, instruction.itype.rd, csr_name, instruction.itype.rs1);
+    }
 }
 
-void print_rtype(char *name, Instruction instruction) {
-  printf(RTYPE_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs1,
-         instruction.rtype.rs2);
+void print_rtype(char *line, char *name, Instruction instruction) {
+  snprintf(line, DISASM_LINE_SIZE, RTYPE_FORMAT, name, instruction.rtype.rd,
+           instruction.rtype.rs1, instruction.rtype.rs2);
   /* YOUR CODE HERE */
 }
 
-void print_itype_except_load(char *name, Instruction instruction, int imm) {
+void print_itype_except_load(char *line, char *name, Instruction instruction, int imm) {
     int sign_extended_imm = sign_extend_number(instruction.itype.imm, 12);
-    printf(ITYPE_FORMAT, name, instruction.itype.rd, instruction.itype.rs1, sign_extended_imm);
+    snprintf(line, DISASM_LINE_SIZE, ITYPE_FORMAT, name, instruction.itype.rd, instruction.itype.rs1, sign_extended_imm);
 }
 
-void print_load(char *name, Instruction instruction) {
+void print_load(char *line, char *name, Instruction instruction) {
     int sign_extended_imm = sign_extend_number(instruction.itype.imm, 12);
-    printf(MEM_FORMAT, name, instruction.itype.rd, sign_extended_imm, instruction.itype.rs1);
+    snprintf(line, DISASM_LINE_SIZE, MEM_FORMAT, name, instruction.itype.rd, sign_extended_imm, instruction.itype.rs1);
 }
 
-void print_store(char *name, Instruction instruction) {
+void print_store(char *line, char *name, Instruction instruction) {
     int offset = get_store_offset(instruction);
-    printf(MEM_FORMAT, name, instruction.stype.rs2, offset, instruction.stype.rs1);
+    snprintf(line, DISASM_LINE_SIZE, MEM_FORMAT, name, instruction.stype.rs2, offset, instruction.stype.rs1);
 }
 
-void print_branch(char *name, Instruction instruction) {
+void print_branch(char *line, char *name, Instruction instruction) {
     int offset = get_branch_offset(instruction);
-    printf(BRANCH_FORMAT, name, instruction.sbtype.rs1, instruction.sbtype.rs2, offset);
+    snprintf(line, DISASM_LINE_SIZE, BRANCH_FORMAT, name, instruction.sbtype.rs1, instruction.sbtype.rs2, offset);
+}
+
+void print_invalid(char *line, Instruction instruction) {
+    snprintf(line, DISASM_LINE_SIZE, INVALID_FORMAT, instruction.bits);
 }
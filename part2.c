@@ -1,8 +1,13 @@
 #include <stdio.h> // for stderr
-#include <stdlib.h> // for exit()
 #include "types.h"
 #include "utils.h"
 #include "riscv.h"
+#include "trace.h"
+#include "statehash.h"
+#include "cosim.h"
+#include "stats.h"
+#include "roi.h"
+#include "csr.h"
 
 void execute_rtype(Instruction, Processor *);
 void execute_itype_except_load(Instruction, Processor *);
@@ -11,6 +16,7 @@ void execute_jal(Instruction, Processor *);
 void execute_load(Instruction, Processor *, Byte *);
 void execute_store(Instruction, Processor *, Byte *);
 void execute_ecall(Processor *, Byte *);
+void execute_csr(Instruction, Processor *);
 void execute_lui(Instruction, Processor *);
 
 void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *memory) {    
@@ -23,7 +29,11 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
             execute_itype_except_load(instruction, processor);
             break;
         case 0x73:
-            execute_ecall(processor, memory);
+            if (instruction.itype.funct3 == 0x0) {
+                execute_ecall(processor, memory);
+            } else {
+                execute_csr(instruction, processor);
+            }
             break;
         case 0x63:
             execute_branch(instruction, processor);
@@ -41,8 +51,9 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
             execute_lui(instruction, processor);
             break;
         default: // undefined opcode
+            STATS_COUNT(STAT_INVALID);
             handle_invalid_instruction(instruction);
-            exit(-1);
+            end_simulation(-1);
             break;
     }
 }
@@ -53,26 +64,30 @@ void execute_rtype(Instruction instruction, Processor *processor) {
             switch (instruction.rtype.funct7) {
                 case 0x0:
                   // Add
+                  STATS_COUNT(STAT_ADD);
                   processor->R[instruction.rtype.rd] =
-                      ((sWord)processor->R[instruction.rtype.rs1]) +
-                      ((sWord)processor->R[instruction.rtype.rs2]);
+                      processor->R[instruction.rtype.rs1] +
+                      processor->R[instruction.rtype.rs2];
 
                   break;
                 case 0x1:
                   // Mul
+                  STATS_COUNT(STAT_MUL);
                   processor->R[instruction.rtype.rd] =
-                      ((sWord)processor->R[instruction.rtype.rs1]) *
-                      ((sWord)processor->R[instruction.rtype.rs2]);
+                      processor->R[instruction.rtype.rs1] *
+                      processor->R[instruction.rtype.rs2];
                   break;
                 case 0x20:
                     // Sub
+                    STATS_COUNT(STAT_SUB);
                     processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) -
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                        processor->R[instruction.rtype.rs1] -
+                        processor->R[instruction.rtype.rs2];
                     break;
                 default:
+                    STATS_COUNT(STAT_INVALID);
                     handle_invalid_instruction(instruction);
-                    exit(-1);
+                    end_simulation(-1);
                     break;
             }
             break;
@@ -80,22 +95,29 @@ void execute_rtype(Instruction instruction, Processor *processor) {
             switch (instruction.rtype.funct7) {
                 case 0x0:
                     // SLL
+                    STATS_COUNT(STAT_SLL);
                     processor->R[instruction.rtype.rd] =
                         processor->R[instruction.rtype.rs1] << 
                         (processor->R[instruction.rtype.rs2] & 0x1F);
                     break;
                 case 0x1:
                     // MULH
+                    STATS_COUNT(STAT_MULH);
                     {
                         sDouble result = (sDouble)((sWord)processor->R[instruction.rtype.rs1]) * 
                                         (sDouble)((sWord)processor->R[instruction.rtype.rs2]);
                         processor->R[instruction.rtype.rd] = (Word)(result >> 32);
                     }
                     break;
+                default:
+                    // does nothing, as engine.c's OP_NOP
+                    STATS_COUNT(STAT_INVALID);
+                    break;
             }
             break;
         case 0x2:
             // SLT
+            STATS_COUNT(STAT_SLT);
             processor->R[instruction.rtype.rd] = 
                 ((sWord)processor->R[instruction.rtype.rs1] < 
                  (sWord)processor->R[instruction.rtype.rs2]) ? 1 : 0;
@@ -104,25 +126,31 @@ void execute_rtype(Instruction instruction, Processor *processor) {
             switch (instruction.rtype.funct7) {
                 case 0x0:
                     // XOR
+                    STATS_COUNT(STAT_XOR);
                     processor->R[instruction.rtype.rd] =
                         processor->R[instruction.rtype.rs1] ^
                         processor->R[instruction.rtype.rs2];
                     break;
                 case 0x1:
                     // DIV
+                    STATS_COUNT(STAT_DIV);
                     {
                         sWord dividend = (sWord)processor->R[instruction.rtype.rs1];
                         sWord divisor = (sWord)processor->R[instruction.rtype.rs2];
                         if (divisor == 0) {
                             processor->R[instruction.rtype.rd] = 0xFFFFFFFF;
+                        } else if (dividend == INT32_MIN && divisor == -1) {
+                            // overflows in C
+                            processor->R[instruction.rtype.rd] = (Word)INT32_MIN;
                         } else {
                             processor->R[instruction.rtype.rd] = (Word)(dividend / divisor);
                         }
                     }
                     break;
                 default:
+                    STATS_COUNT(STAT_INVALID);
                     handle_invalid_instruction(instruction);
-                    exit(-1);
+                    end_simulation(-1);
                     break;
             }
             break;
@@ -130,12 +158,14 @@ void execute_rtype(Instruction instruction, Processor *processor) {
             switch (instruction.rtype.funct7) {
                 case 0x0:
                 // SRL      
+                    STATS_COUNT(STAT_SRL);
                     processor->R[instruction.rtype.rd] =
                         processor->R[instruction.rtype.rs1] >> 
                         (processor->R[instruction.rtype.rs2] & 0x1F);
                     break;
                 case 0x20:
                     // SRA
+                    STATS_COUNT(STAT_SRA);
                     {
                         sWord value = (sWord)processor->R[instruction.rtype.rs1];
                         int shift = processor->R[instruction.rtype.rs2] & 0x1F;
@@ -143,8 +173,9 @@ void execute_rtype(Instruction instruction, Processor *processor) {
                     }
                     break;
                 default:
+                    STATS_COUNT(STAT_INVALID);
                     handle_invalid_instruction(instruction);
-                    exit(-1);
+                    end_simulation(-1);
                 break;
             }
             break;
@@ -152,37 +183,45 @@ void execute_rtype(Instruction instruction, Processor *processor) {
             switch (instruction.rtype.funct7) {
                 case 0x0:
                     // OR
+                    STATS_COUNT(STAT_OR);
                     processor->R[instruction.rtype.rd] =
                         processor->R[instruction.rtype.rs1] |
                         processor->R[instruction.rtype.rs2];
                     break;
                 case 0x1:
                     // REM
+                    STATS_COUNT(STAT_REM);
                     {
                         sWord dividend = (sWord)processor->R[instruction.rtype.rs1];
                         sWord divisor = (sWord)processor->R[instruction.rtype.rs2];
                         if (divisor == 0) {
                             processor->R[instruction.rtype.rd] = (Word)dividend;
+                        } else if (dividend == INT32_MIN && divisor == -1) {
+                            // overflows in C
+                            processor->R[instruction.rtype.rd] = 0;
                         } else {
                             processor->R[instruction.rtype.rd] = (Word)(dividend % divisor);
                         }
                     }
                     break;
                 default:
+                    STATS_COUNT(STAT_INVALID);
                     handle_invalid_instruction(instruction);
-                    exit(-1);
+                    end_simulation(-1);
                     break;
             }
             break;
         case 0x7:
             // AND
+            STATS_COUNT(STAT_AND);
             processor->R[instruction.rtype.rd] =
                 processor->R[instruction.rtype.rs1] &
                 processor->R[instruction.rtype.rs2];
             break;
         default:
+            STATS_COUNT(STAT_INVALID);
             handle_invalid_instruction(instruction);
-            exit(-1);
+            end_simulation(-1);
             break;
     }
     processor->PC += 4;
@@ -192,20 +231,23 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
     switch (instruction.itype.funct3) {
         case 0x0:
             // ADDI
+            STATS_COUNT(STAT_ADDI);
             {
                 int imm = sign_extend_number(instruction.itype.imm, 12);
                 processor->R[instruction.itype.rd] = 
-                    ((sWord)processor->R[instruction.itype.rs1]) + imm;
+                    processor->R[instruction.itype.rs1] + imm;
             }
             break;
         case 0x1:
             // SLLI
+            STATS_COUNT(STAT_SLLI);
             processor->R[instruction.itype.rd] = 
                 processor->R[instruction.itype.rs1] << 
                 (instruction.itype.imm & 0x1F);
             break;
         case 0x2:
             // SLTI
+            STATS_COUNT(STAT_SLTI);
             {
                 int imm = sign_extend_number(instruction.itype.imm, 12);
                 processor->R[instruction.itype.rd] = 
@@ -214,6 +256,7 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
             break;
         case 0x4:
             // XORI
+            STATS_COUNT(STAT_XORI);
             {
                 int imm = sign_extend_number(instruction.itype.imm, 12);
                 processor->R[instruction.itype.rd] = 
@@ -227,20 +270,24 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
                 int shift_type = instruction.itype.imm >> 10;
                 if (shift_type == 0x0) {
                     // SRLI - logical right shift
+                    STATS_COUNT(STAT_SRLI);
                     processor->R[instruction.itype.rd] = 
                         processor->R[instruction.itype.rs1] >> shift_amount;
                 } else if (shift_type == 0x1) {
                     // SRAI - arithmetic right shift
+                    STATS_COUNT(STAT_SRAI);
                     sWord value = (sWord)processor->R[instruction.itype.rs1];
                     processor->R[instruction.itype.rd] = (Word)(value >> shift_amount);
                 } else {
+                    STATS_COUNT(STAT_INVALID);
                     handle_invalid_instruction(instruction);
-                    exit(-1);
+                    end_simulation(-1);
                 }
             }
             break;
         case 0x6:
             // ORI
+            STATS_COUNT(STAT_ORI);
             {
                 int imm = sign_extend_number(instruction.itype.imm, 12);
                 processor->R[instruction.itype.rd] = 
@@ -249,6 +296,7 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
             break;
         case 0x7:
             // ANDI
+            STATS_COUNT(STAT_ANDI);
             {
                 int imm = sign_extend_number(instruction.itype.imm, 12);
                 processor->R[instruction.itype.rd] = 
@@ -256,6 +304,7 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
             }
             break;
         default:
+            STATS_COUNT(STAT_INVALID);
             handle_invalid_instruction(instruction);
             break;
     }
@@ -264,81 +313,122 @@ void execute_itype_except_load(Instruction instruction, Processor *processor) {
 
 void execute_ecall(Processor *p, Byte *memory) {
     Register i;
+    char text[64];
+    int length = 0;
     
+    STATS_COUNT(STAT_ECALL);
     // syscall number is given by a0 (x10)
     // argument is given by a1
     switch(p->R[10]) {
         case 1: // print an integer
-            printf("%d",p->R[11]);
+            console_print("%d",p->R[11]);
             break;
         case 4: // print a string
             for(i=p->R[11];i<MEMORY_SPACE && load(memory,i,LENGTH_BYTE);i++) {
-                printf("%c",load(memory,i,LENGTH_BYTE));
+                text[length++] = load(memory,i,LENGTH_BYTE);
+                if (length == sizeof(text) - 1) {
+                    text[length] = '\0';
+                    console_print("%s", text);
+                    length = 0;
+                }
             }
+            text[length] = '\0';
+            console_print("%s", text);
             break;
         case 10: // exit
-            printf("exiting the simulator\n");
-            exit(0);
+            console_print("exiting the simulator\n");
+            end_simulation(0);
             break;
         case 11: // print a character
-            printf("%c",p->R[11]);
+            console_print("%c",p->R[11]);
+            break;
+        case ROI_BEGIN: // regions of interest, see roi.h
+        case ROI_END:
+        case ROI_RESET:
+        case ROI_DUMP:
+            roi_ecall(p, memory);
+            p->PC += 4;
             break;
         default: // undefined ecall
-            printf("Illegal ecall number %d\n", p->R[10]);
-            exit(-1);
+            console_print("Illegal ecall number %d\n", p->R[10]);
+            end_simulation(-1);
             break;
     }
 }
 
+void execute_csr(Instruction instruction, Processor *processor) {
+    // the counters, read-only, see csr.h
+    if (csr_execute(instruction, processor) == 0) {
+        STATS_COUNT(STAT_CSR);
+    } else {
+        STATS_COUNT(STAT_INVALID);
+        handle_invalid_instruction(instruction);
+        end_simulation(-1);
+    }
+}
+
 void execute_branch(Instruction instruction, Processor *processor) {
     switch (instruction.sbtype.funct3) {
         case 0x0:
             // BEQ
+            STATS_COUNT(STAT_BEQ);
             {
                 int offset = get_branch_offset(instruction);
                 if (processor->R[instruction.sbtype.rs1] == processor->R[instruction.sbtype.rs2]) {
+                    STATS_COUNT(STAT_TAKEN);
                     processor->PC += offset;
                 } else {
+                    STATS_COUNT(STAT_NOT_TAKEN);
                     processor->PC += 4;
                 }
             }
             break;
         case 0x1:
             // BNE
+            STATS_COUNT(STAT_BNE);
             {
                 int offset = get_branch_offset(instruction);
                 if (processor->R[instruction.sbtype.rs1] != processor->R[instruction.sbtype.rs2]) {
+                    STATS_COUNT(STAT_TAKEN);
                     processor->PC += offset;
                 } else {
+                    STATS_COUNT(STAT_NOT_TAKEN);
                     processor->PC += 4;
                 }
             }
             break;
         case 0x4:
             // BLT
+            STATS_COUNT(STAT_BLT);
             {
                 int offset = get_branch_offset(instruction);
                 if ((sWord)processor->R[instruction.sbtype.rs1] < (sWord)processor->R[instruction.sbtype.rs2]) {
+                    STATS_COUNT(STAT_TAKEN);
                     processor->PC += offset;
                 } else {
+                    STATS_COUNT(STAT_NOT_TAKEN);
                     processor->PC += 4;
                 }
             }
             break;
         case 0x5:
             // BGE
+            STATS_COUNT(STAT_BGE);
             {
                 int offset = get_branch_offset(instruction);
                 if ((sWord)processor->R[instruction.sbtype.rs1] >= (sWord)processor->R[instruction.sbtype.rs2]) {
+                    STATS_COUNT(STAT_TAKEN);
                     processor->PC += offset;
                 } else {
+                    STATS_COUNT(STAT_NOT_TAKEN);
                     processor->PC += 4;
                 }
             }
             break;
         default:
+            STATS_COUNT(STAT_INVALID);
             handle_invalid_instruction(instruction);
-            exit(-1);
+            end_simulation(-1);
             break;
     }
     processor->PC += 4;
@@ -348,29 +438,42 @@ void execute_load(Instruction instruction, Processor *processor, Byte *memory) {
     switch (instruction.itype.funct3) {
         case 0x0:
             // LB
+            STATS_COUNT(STAT_LB);
             {
                 int imm = sign_extend_number(instruction.itype.imm, 12);
                 Address addr = processor->R[instruction.itype.rs1] + imm;
                 processor->R[instruction.itype.rd] = load(memory, addr, LENGTH_BYTE);
+                if (trace_active) {
+                    trace_mem_access(addr, LENGTH_BYTE, processor->R[instruction.itype.rd], 0);
+                }
             }
             break;
         case 0x1:
             // LH
+            STATS_COUNT(STAT_LH);
             {
                 int imm = sign_extend_number(instruction.itype.imm, 12);
                 Address addr = processor->R[instruction.itype.rs1] + imm;
                 processor->R[instruction.itype.rd] = load(memory, addr, LENGTH_HALF_WORD);
+                if (trace_active) {
+                    trace_mem_access(addr, LENGTH_HALF_WORD, processor->R[instruction.itype.rd], 0);
+                }
             }
             break;
         case 0x2:
             // LW
+            STATS_COUNT(STAT_LW);
             {
                 int imm = sign_extend_number(instruction.itype.imm, 12);
                 Address addr = processor->R[instruction.itype.rs1] + imm;
                 processor->R[instruction.itype.rd] = load(memory, addr, LENGTH_WORD);
+                if (trace_active) {
+                    trace_mem_access(addr, LENGTH_WORD, processor->R[instruction.itype.rd], 0);
+                }
             }
             break;
         default:
+            STATS_COUNT(STAT_INVALID);
             handle_invalid_instruction(instruction);
             break;
     }
@@ -381,52 +484,73 @@ void execute_store(Instruction instruction, Processor *processor, Byte *memory)
     switch (instruction.stype.funct3) {
         case 0x0:
             // SB
+            STATS_COUNT(STAT_SB);
             {
                 int offset = get_store_offset(instruction);
                 Address addr = processor->R[instruction.stype.rs1] + offset;
                 store(memory, addr, LENGTH_BYTE, processor->R[instruction.stype.rs2]);
+                if (trace_active) {
+                    trace_mem_access(addr, LENGTH_BYTE, processor->R[instruction.stype.rs2], 1);
+                }
             }
             break;
         case 0x1:
             // SH
+            STATS_COUNT(STAT_SH);
             {
                 int offset = get_store_offset(instruction);
                 Address addr = processor->R[instruction.stype.rs1] + offset;
                 store(memory, addr, LENGTH_HALF_WORD, processor->R[instruction.stype.rs2]);
+                if (trace_active) {
+                    trace_mem_access(addr, LENGTH_HALF_WORD, processor->R[instruction.stype.rs2], 1);
+                }
             }
             break;
         case 0x2:
             // SW
+            STATS_COUNT(STAT_SW);
             {
                 int offset = get_store_offset(instruction);
                 Address addr = processor->R[instruction.stype.rs1] + offset;
                 store(memory, addr, LENGTH_WORD, processor->R[instruction.stype.rs2]);
+                if (trace_active) {
+                    trace_mem_access(addr, LENGTH_WORD, processor->R[instruction.stype.rs2], 1);
+                }
             }
             break;
         default:
+            STATS_COUNT(STAT_INVALID);
             handle_invalid_instruction(instruction);
-            exit(-1);
+            end_simulation(-1);
             break;
     }
     processor->PC += 4;
 }
 
 void execute_jal(Instruction instruction, Processor *processor) {
+    STATS_COUNT(STAT_JAL);
     int offset = get_jump_offset(instruction);
     processor->R[instruction.ujtype.rd] = processor->PC + 4;
     processor->PC += offset;
 }
 
 void execute_lui(Instruction instruction, Processor *processor) {
-    processor->R[instruction.utype.rd] = instruction.utype.imm << 12;
+    STATS_COUNT(STAT_LUI);
+    processor->R[instruction.utype.rd] = (Word)instruction.utype.imm << 12;
     processor->PC += 4;
 }
 
 void store(Byte *memory, Address address, Alignment alignment, Word value) {
-    if (address + alignment > MEMORY_SPACE) {
+    if (address > MEMORY_SPACE - alignment) {
         handle_invalid_write(address);
         return;
     }
+    if (statehash_active) {
+        statehash_store(memory, address, alignment, value);
+    }
+    if (cosim_active) {
+        cosim_store(address, alignment);
+    }
     
     switch (alignment) {
         case LENGTH_BYTE:
@@ -449,7 +573,7 @@ void store(Byte *memory, Address address, Alignment alignment, Word value) {
 }
 
 Word load(Byte *memory, Address address, Alignment alignment) {
-    if (address + alignment > MEMORY_SPACE) {
+    if (address > MEMORY_SPACE - alignment) {
         handle_invalid_read(address);
         return 0;
     }
@@ -1,4 +1,21 @@
 #include "riscv.h"
+#include "blockprof.h"
+#include "cache.h"
+#include "callgraph.h"
+#include "check.h"
+#include "cosim.h"
+#include "csr.h"
+#include "cycles.h"
+#include "engine.h"
+#include "hostprof.h"
+#include "roi.h"
+#include "sample.h"
+#include "statehash.h"
+#include "stats.h"
+#include "symbols.h"
+#include "trace.h"
+#include "tracestream.h"
+#include "utils.h"
 #include <assert.h>
 #include <getopt.h>
 #include <stdarg.h>
@@ -14,45 +31,117 @@
 
 // Pointer to simulator memory
 Byte *memory;
+// engine.c, if it runs the program instead of part2.c
+static Engine *fast_engine = NULL;
+// instructions started, the one that ended the run included
+static Double executed = 0;
 #define MAX_SIZE 50
 
 void execute(Processor *processor, int prompt, int print) {
   /* fetch an instruction */
   uint32_t instruction_bits = load(memory, processor->PC, LENGTH_WORD);
+  executed++;
+  if (executed >= sample_next) {
+    sample_take(processor->PC, executed);
+  }
+  int traced = !trace_filtering || trace_filter_check(processor);
 
   /* interactive-mode prompt */
-  if (prompt) {
+  if (prompt && traced) {
     if (prompt == 1) {
       printf("simulator paused,enter to continue...");
       while (getchar() != '\n')
         ;
     }
 
-    printf("%08x: ", processor->PC);
-    decode_instruction(instruction_bits);
+    int length;
+    const char *line =
+        disassembly_line(processor->PC, instruction_bits, &length);
+
+    fwrite(line, 1, length, stdout);
+  }
+
+  if (trace_active && traced) {
+    trace_begin(processor->PC, instruction_bits);
+  }
+  if (check_active) {
+    check_begin(processor->PC, instruction_bits);
+  }
+  if (cosim_active) {
+    cosim_begin(processor->PC, instruction_bits);
+  }
+  if (callgraph_active) {
+    callgraph_begin(processor->PC);
   }
 
-  execute_instruction(instruction_bits, processor, memory);
+  Word pc = processor->PC;
+  Double start = hostprof_active ? read_cycles() : 0;
+
+  if (fast_engine != NULL) {
+    int status;
+
+    if (engine_step(fast_engine, processor, &status)) {
+      end_simulation(status);
+    }
+  } else {
+    execute_instruction(instruction_bits, processor, memory);
+  }
+  if (hostprof_active) {
+    hostprof_add(instruction_bits, read_cycles() - start);
+  }
 
   // enforce $0 being hard-wired to 0
   processor->R[0] = 0;
 
+  if (trace_active && traced) {
+    trace_end(processor);
+  }
+  if (check_active) {
+    check_end(processor);
+  }
+  if (cosim_active) {
+    cosim_end(processor, memory);
+  }
+  if (callgraph_active) {
+    callgraph_end(pc, instruction_bits, processor);
+  }
+  if (statehash_active) {
+    statehash_step(processor, traced);
+  }
+
   // print trace
-  if (print) {
-    int i, j;
+  if (print && traced) {
+    print_registers(stdout, processor->R);
+  }
+}
 
-    for (i = 0; i < 8; i++) {
-      for (j = 0; j < 4; j++) {
-        printf("r%2d=%08x ", i * 4 + j, processor->R[i * 4 + j]);
-      }
+/* what the regions of interest and the CSR counters count */
+static Double instructions_started(void) { return executed; }
 
-      puts("");
-    }
+/* --count-instructions, for benchmarks to turn times into MIPS */
+static void print_instruction_count(void) {
+  fflush(stdout);
+  fprintf(stderr, "instructions: %llu\n", (unsigned long long)executed);
+}
+
+/* the region report has host cycles, which a cache hit would pass off
+ * as new */
+static int cacheable(void) { return !roi_used(); }
 
-    printf("\n");
+/* --cosim and --check have the last word on the exit status */
+static int final_status(int status) {
+  if (cosim_active) {
+    status = cosim_close(status);
   }
+  if (check_active) {
+    status = check_close(status);
+  }
+  return status;
 }
 
+/* the exit_hook with --cosim or --check */
+static void exit_checked(int status) { exit(final_status(status)); }
+
 void init_args(Processor *processor, char *arg) {
   char *token = strtok(arg, ",");
   int i = 0;
@@ -90,7 +179,26 @@ int load_file(uint8_t *mem, size_t memsize, int startaddr, const char *filename,
 int main(int argc, char **argv) {
   /* options */
   int opt_disasm = 0, opt_regdump = 0, opt_interactive = 0, opt_exit = 0,
-      opt_init_reg = 0;
+      opt_init_reg = 0, opt_fast = 0, opt_cosim = 0, opt_count = 0,
+      opt_hostprof = 0, opt_stats = 0, opt_blockprof = 0;
+  char *trace_bin_file = NULL, *trace_delta_file = NULL,
+       *trace_mem_file = NULL, *check_file = NULL, *disasm_file = NULL,
+       *hash_file = NULL, *hostprof_file = NULL, *stats_file = NULL,
+       *blockprof_file = NULL, *symbols_file = NULL, *sample_file = NULL,
+       *callgraph_file = NULL;
+  Double hash_interval = 1, sample_every = 1000;
+  long sample_timer = 0;
+  char *cache_dir = getenv("RISCV_CACHE");
+  /* set by every option a cache hit could not reproduce: one that writes
+   * a file, measures the host or waits for the user */
+  int uncached = 0;
+  int trace_fetch = 0;
+  int trace_codec = TRACE_CODEC_NONE;
+  int trace_async = 0, trace_stats = 0;
+  int disasm_threads = 0;
+  TraceFilter trace_filter;
+  int opt_filter = 0;
+  char *end;
 
   /* the architectural state of the CPU */
   Processor processor;
@@ -104,8 +212,42 @@ int main(int argc, char **argv) {
   char *data_file = NULL;
   // int a1;
   /* parse the command-line args */
+  static struct option long_options[] = {
+      {"cache", required_argument, NULL, 'C'},
+      {"fast", no_argument, NULL, 'G'},
+      {"cosim", no_argument, NULL, 'Q'},
+      {"count-instructions", no_argument, NULL, 'Y'},
+      {"host-profile", optional_argument, NULL, 'U'},
+      {"stats", optional_argument, NULL, 'V'},
+      {"block-profile", optional_argument, NULL, 'L'},
+      {"symbols", required_argument, NULL, 'W'},
+      {"sample", required_argument, NULL, 'p'},
+      {"sample-every", required_argument, NULL, 'n'},
+      {"sample-timer", required_argument, NULL, 'u'},
+      {"callgraph", required_argument, NULL, 'g'},
+      {"state-hash", required_argument, NULL, 'H'},
+      {"state-hash-every", required_argument, NULL, 'E'},
+      {"disasm-out", required_argument, NULL, 'O'},
+      {"disasm-threads", required_argument, NULL, 'J'},
+      {"check", required_argument, NULL, 'K'},
+      {"trace-bin", required_argument, NULL, 'B'},
+      {"trace-delta", required_argument, NULL, 'D'},
+      {"trace-compress", optional_argument, NULL, 'Z'},
+      {"trace-mem", required_argument, NULL, 'M'},
+      {"trace-fetch", no_argument, NULL, 'I'},
+      {"trace-async", no_argument, NULL, 'A'},
+      {"trace-stats", no_argument, NULL, 'S'},
+      {"trace-from", required_argument, NULL, 'F'},
+      {"trace-to", required_argument, NULL, 'T'},
+      {"trace-count", required_argument, NULL, 'N'},
+      {"trace-pc", required_argument, NULL, 'P'},
+      {"trace-start-pc", required_argument, NULL, 'X'},
+      {"trace-start-reg", required_argument, NULL, 'R'},
+      {NULL, 0, NULL, 0}};
   int c;
-  while ((c = getopt(argc, argv, "dvrites:a:")) != -1) {
+  trace_filter_init(&trace_filter);
+  while ((c = getopt_long(argc, argv, "dvrites:a:", long_options, NULL)) !=
+         -1) {
     switch (c) {
     case 'd':
       opt_disasm = 1;
@@ -118,6 +260,7 @@ int main(int argc, char **argv) {
       break;
     case 'i':
       opt_interactive = 1;
+      uncached = 1;
       break;
     case 't':
       opt_interactive = 2;
@@ -134,6 +277,138 @@ int main(int argc, char **argv) {
       // Read hex value as integer
       // a1 = (int32_t)strtol(optarg, NULL, 16);
       break;
+    case 'C':
+      cache_dir = optarg;
+      break;
+    case 'G':
+      opt_fast = 1;
+      break;
+    case 'Q':
+      opt_cosim = 1;
+      break;
+    case 'Y':
+      opt_count = 1;
+      break;
+    case 'U':
+      opt_hostprof = 1;
+      hostprof_file = optarg;
+      uncached = 1;
+      break;
+    case 'V':
+      opt_stats = 1;
+      stats_file = optarg;
+      uncached |= optarg != NULL;
+      break;
+    case 'L':
+      opt_blockprof = 1;
+      blockprof_file = optarg;
+      uncached |= optarg != NULL;
+      break;
+    case 'W':
+      symbols_file = optarg;
+      break;
+    case 'p':
+      sample_file = optarg;
+      uncached = 1;
+      break;
+    case 'n':
+      sample_every = strtoull(optarg, NULL, 0);
+      if (sample_every == 0) {
+        fprintf(stderr, "Bad sampling interval %s\n", optarg);
+        return -1;
+      }
+      break;
+    case 'u':
+      sample_timer = strtol(optarg, NULL, 0);
+      break;
+    case 'g':
+      callgraph_file = optarg;
+      uncached = 1;
+      break;
+    case 'O':
+      disasm_file = optarg;
+      uncached = 1;
+      break;
+    case 'H':
+      hash_file = optarg;
+      uncached = 1;
+      break;
+    case 'E':
+      hash_interval = strtoull(optarg, NULL, 0);
+      break;
+    case 'J':
+      disasm_threads = atoi(optarg);
+      break;
+    case 'K':
+      check_file = optarg;
+      break;
+    case 'B':
+      trace_bin_file = optarg;
+      uncached = 1;
+      break;
+    case 'D':
+      trace_delta_file = optarg;
+      uncached = 1;
+      break;
+    case 'M':
+      trace_mem_file = optarg;
+      uncached = 1;
+      break;
+    case 'I':
+      trace_fetch = 1;
+      break;
+    case 'A':
+      trace_async = 1;
+      break;
+    case 'S':
+      trace_stats = 1;
+      uncached = 1;
+      break;
+    case 'F':
+      trace_filter.from = strtoull(optarg, NULL, 0);
+      opt_filter = 1;
+      break;
+    case 'T':
+      trace_filter.to = strtoull(optarg, NULL, 0);
+      opt_filter = 1;
+      break;
+    case 'N':
+      trace_filter.count = strtoull(optarg, NULL, 0);
+      opt_filter = 1;
+      break;
+    case 'P':
+      /* lo-hi, both included */
+      trace_filter.pc_lo = strtoul(optarg, &end, 0);
+      if (*end != '-') {
+        fprintf(stderr, "Bad pc range %s\n", optarg);
+        return -1;
+      }
+      trace_filter.pc_hi = strtoul(end + 1, NULL, 0);
+      opt_filter = 1;
+      break;
+    case 'X':
+      trace_filter.start_on_pc = 1;
+      trace_filter.start_pc = strtoul(optarg, NULL, 0);
+      opt_filter = 1;
+      break;
+    case 'R':
+      /* xN=value */
+      trace_filter.start_reg = strtol(optarg + (optarg[0] == 'x'), &end, 10);
+      if (*end != '=' || trace_filter.start_reg < 0 ||
+          trace_filter.start_reg > 31) {
+        fprintf(stderr, "Bad register trigger %s\n", optarg);
+        return -1;
+      }
+      trace_filter.start_value = strtoul(end + 1, NULL, 0);
+      opt_filter = 1;
+      break;
+    case 'Z':
+      trace_codec = trace_codec_by_name(optarg);
+      if (trace_codec < 0) {
+        fprintf(stderr, "Unknown trace compression %s\n", optarg);
+        return -1;
+      }
+      break;
     default:
       fprintf(stderr, "Bad option %c\n", c);
       return -1;
@@ -159,6 +434,24 @@ int main(int argc, char **argv) {
     return -1;
   }
 
+  if (cache_dir != NULL && cache_dir[0] != '\0' && !uncached) {
+    const char *inputs[5] = {argv[optind]};
+    int input_count = 1, status;
+
+    if (data_file != NULL) {
+      inputs[input_count++] = data_file;
+    }
+    if (check_file != NULL) {
+      inputs[input_count++] = check_file;
+    }
+    if (symbols_file != NULL) {
+      inputs[input_count++] = symbols_file;
+    }
+    if (cache_begin(cache_dir, argc, argv, inputs, cacheable, &status)) {
+      return status;
+    }
+  }
+
   /* load the executable into memory */
   assert(memory == NULL);
   memory = calloc(MEMORY_SPACE, sizeof(uint8_t)); // allocate zeroed memory
@@ -167,7 +460,7 @@ int main(int argc, char **argv) {
   /* SEt the PC to 0x1000 */
   processor.PC = 0x1000;
   prog_numins =
-      load_file(memory, MEMORY_SPACE, processor.PC, argv[optind], opt_disasm);
+      load_file(memory, MEMORY_SPACE, processor.PC, argv[optind], 0);
   // Loading data
   if (data_file != NULL) {
     load_file(memory, MEMORY_SPACE, processor.R[3], data_file, 0);
@@ -177,8 +470,25 @@ int main(int argc, char **argv) {
   //   printf("%08x, %08x \n", i, result);
   // }
 
+  /* --disasm-out writes what -d prints to a file and goes on to run the
+   * program, which then finds the lines -t prints already formatted */
+  if (disasm_file != NULL) {
+    FILE *out = fopen(disasm_file, "w");
+
+    if (out == NULL) {
+      fprintf(stderr, "Cannot open disassembly file %s\n", disasm_file);
+      return -1;
+    }
+    disassemble_image(out, memory, processor.PC, prog_numins, disasm_threads);
+    fclose(out);
+  }
+
   /* if we're just disassembling,exit here */
   if (opt_disasm) {
+    if (disasm_file == NULL) {
+      disassemble_image(stdout, memory, processor.PC, prog_numins,
+                        disasm_threads);
+    }
     return 0;
   }
 
@@ -188,6 +498,103 @@ int main(int argc, char **argv) {
   //   processor.R[11] = a1;
   // }
 
+  if (check_file != NULL && check_open(check_file, &processor) != 0) {
+    fprintf(stderr, "Cannot check against %s\n", check_file);
+    return -1;
+  }
+  /* --cosim runs part2.c with engine.c in its shadow, whatever --fast
+   * says */
+  if (opt_cosim && cosim_open(&processor, memory) != 0) {
+    fprintf(stderr, "Cannot start the co-simulation\n");
+    return -1;
+  }
+  if (check_active || cosim_active) {
+    exit_hook = exit_checked;
+  }
+  /* the block profile is counted by engine.c, so it runs the program */
+  if (opt_blockprof && opt_cosim) {
+    fprintf(stderr, "--block-profile cannot be used with --cosim\n");
+    return -1;
+  }
+  if ((opt_fast || opt_blockprof) && !opt_cosim) {
+    fast_engine = engine_create(memory, 0);
+    assert(fast_engine != NULL);
+  }
+  if (symbols_file != NULL && symbols_load(symbols_file) != 0) {
+    fprintf(stderr, "Cannot read symbols from %s\n", symbols_file);
+    return -1;
+  }
+  if (opt_blockprof &&
+      blockprof_open(blockprof_file, fast_engine, memory) != 0) {
+    fprintf(stderr, "Cannot open block profile %s\n", blockprof_file);
+    return -1;
+  }
+  if (sample_file != NULL &&
+      sample_open(sample_file, sample_every, sample_timer) != 0) {
+    fprintf(stderr, "Cannot open sample file %s\n", sample_file);
+    return -1;
+  }
+  if (callgraph_file != NULL &&
+      callgraph_open(callgraph_file, &processor) != 0) {
+    fprintf(stderr, "Cannot open call graph file %s\n", callgraph_file);
+    return -1;
+  }
+  if (opt_filter) {
+    trace_set_filter(&trace_filter);
+  }
+  if (trace_bin_file != NULL &&
+      trace_open_binary(trace_bin_file, &processor, trace_codec) != 0) {
+    fprintf(stderr, "Cannot open trace file %s\n", trace_bin_file);
+    return -1;
+  }
+  if (trace_delta_file != NULL &&
+      trace_open_delta(trace_delta_file, &processor, trace_codec) != 0) {
+    fprintf(stderr, "Cannot open trace file %s\n", trace_delta_file);
+    return -1;
+  }
+  if (hash_file != NULL &&
+      statehash_open(hash_file, &processor, trace_codec, hash_interval) != 0) {
+    fprintf(stderr, "Cannot open state hash file %s\n", hash_file);
+    return -1;
+  }
+  if (trace_mem_file != NULL &&
+      trace_open_memory(trace_mem_file, &processor, trace_codec,
+                        trace_fetch) != 0) {
+    fprintf(stderr, "Cannot open trace file %s\n", trace_mem_file);
+    return -1;
+  }
+  if (trace_async) {
+    /* -r and -t are printed by the writer thread too, unless the run is
+     * paused after every instruction with -i */
+    if (opt_interactive != 1 && (opt_regdump || opt_interactive == 2) &&
+        trace_open_text(stdout, &processor, opt_regdump,
+                        opt_interactive == 2) == 0) {
+      opt_regdump = opt_interactive = 0;
+    }
+    if (trace_start_async(trace_stats ? stderr : NULL) != 0) {
+      fprintf(stderr, "Cannot start the trace writer\n");
+      return -1;
+    }
+  }
+
+  roi_open(instructions_started);
+  csr_open(instructions_started);
+  if (opt_count) {
+    atexit(print_instruction_count);
+  }
+  if (opt_hostprof && hostprof_open(hostprof_file) != 0) {
+    fprintf(stderr, "Cannot open host profile %s\n", hostprof_file);
+    return -1;
+  }
+  if (opt_stats && stats_open(stats_file) != 0) {
+#ifdef SIM_STATS
+    fprintf(stderr, "Cannot open statistics file %s\n", stats_file);
+#else
+    fprintf(stderr, "--stats needs a build with SIM_STATS (make STATS=1)\n");
+#endif
+    return -1;
+  }
+
   int simins = 0;
 
   if (opt_exit) {
@@ -202,5 +609,5 @@ int main(int argc, char **argv) {
       simins++;
     }
   }
-  return 0;
+  return final_status(0);
 }
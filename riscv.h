@@ -1,10 +1,18 @@
 #ifndef MIPS_H
 #define MIPS_H
 
+#include <stdio.h>
 #include "types.h"
 
+/* longest line disassemble_instruction() produces, with its terminator */
+#define DISASM_LINE_SIZE 64
+
 /* see part1.c */
 void decode_instruction(uint32_t instruction_bits);
+void disassemble_instruction(char *line, uint32_t instruction_bits);
+const char *disassembly_line(Address pc, uint32_t instruction_bits, int *length);
+void disassemble_image(FILE *out, const Byte *memory, Address start, int count,
+                       int threads);
 
 /* see part2.c */
 void execute_instruction(uint32_t instruction_bits, Processor* processor, Byte *memory);
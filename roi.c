@@ -0,0 +1,210 @@
+#include "roi.h"
+#include "cycles.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_REGIONS 32
+#define MAX_NESTING 16
+
+typedef struct {
+  char name[32];
+  Double entries, instructions, cycles;
+  Double start_instructions, start_cycles;
+  int open; /* entries in progress */
+#ifdef SIM_STATS
+  Double mix[STAT_EVENTS], start_mix[STAT_EVENTS];
+#endif
+} Region;
+
+static Region regions[MAX_REGIONS];
+static int region_count = 0, nesting[MAX_NESTING], depth = 0;
+static Double (*count_instructions)(void) = NULL;
+static int used = 0;
+
+static Double instructions_now(void) {
+  return count_instructions != NULL ? count_instructions() : 0;
+}
+
+/* the name at address, cut to fit */
+static void read_name(const Byte *memory, Address address, char *name,
+                      int size) {
+  int i = 0;
+
+  if (address == 0) {
+    strcpy(name, "roi");
+    return;
+  }
+  while (i < size - 1 && address < MEMORY_SPACE && memory[address] != '\0') {
+    name[i++] = memory[address++];
+  }
+  name[i] = '\0';
+}
+
+/* -1 if there is no such region and it is not to be made, or if there
+ * are too many */
+static int find_region(const char *name, int make) {
+  int id;
+
+  for (id = 0; id < region_count; id++) {
+    if (strcmp(regions[id].name, name) == 0) {
+      return id;
+    }
+  }
+  if (!make || region_count == MAX_REGIONS) {
+    return -1;
+  }
+  memset(&regions[region_count], 0, sizeof(Region));
+  strcpy(regions[region_count].name, name);
+  return region_count++;
+}
+
+static void begin(int id) {
+  Region *region = &regions[id];
+
+  if (depth == MAX_NESTING) {
+    return;
+  }
+  nesting[depth++] = id;
+  region->entries++;
+  /* a region entered inside itself is counted from the outer entry */
+  if (region->open++ == 0) {
+    region->start_instructions = instructions_now();
+    region->start_cycles = read_cycles();
+#ifdef SIM_STATS
+    memcpy(region->start_mix, stats_counts, sizeof(stats_counts));
+#endif
+  }
+}
+
+/* the counts of a region up to now, leaving it open */
+static void add_progress(Region *region) {
+  Double now = instructions_now(), cycles = read_cycles();
+
+  region->instructions += now - region->start_instructions;
+  region->cycles += cycles - region->start_cycles;
+  region->start_instructions = now;
+  region->start_cycles = cycles;
+#ifdef SIM_STATS
+  {
+    int i;
+
+    for (i = 0; i < STAT_EVENTS; i++) {
+      region->mix[i] += stats_counts[i] - region->start_mix[i];
+    }
+    memcpy(region->start_mix, stats_counts, sizeof(stats_counts));
+  }
+#endif
+}
+
+static void end(int id) {
+  int level;
+
+  for (level = depth - 1; level >= 0; level--) {
+    if (nesting[level] == id) {
+      break;
+    }
+  }
+  if (level < 0) {
+    return;
+  }
+  /* regions left open inside it end with it */
+  while (depth > level) {
+    Region *region = &regions[nesting[--depth]];
+
+    if (--region->open == 0) {
+      add_progress(region);
+    }
+  }
+}
+
+/* zeroes the counts; open regions stay open and count from now */
+static void reset(void) {
+  int id;
+
+  for (id = 0; id < region_count; id++) {
+    Region *region = &regions[id];
+
+    region->entries = region->instructions = region->cycles = 0;
+    region->start_instructions = instructions_now();
+    region->start_cycles = read_cycles();
+#ifdef SIM_STATS
+    memset(region->mix, 0, sizeof(region->mix));
+    memcpy(region->start_mix, stats_counts, sizeof(stats_counts));
+#endif
+  }
+}
+
+static void print_regions(void) {
+  int id;
+
+  fflush(stdout);
+  fprintf(stderr, "regions of interest:\n");
+  fprintf(stderr, "  %-20s %10s %14s %14s\n", "region", "entries",
+          "instructions", "host cycles");
+  for (id = 0; id < region_count; id++) {
+    Region *region = &regions[id];
+
+    if (region->open != 0) {
+      add_progress(region);
+    }
+    fprintf(stderr, "  %-20s %10llu %14llu %14llu\n", region->name,
+            (unsigned long long)region->entries,
+            (unsigned long long)region->instructions,
+            (unsigned long long)region->cycles);
+#ifdef SIM_STATS
+    stats_print_categories(stderr, region->mix, "      ");
+#endif
+  }
+}
+
+static void roi_close(void) {
+  if (region_count != 0) {
+    print_regions();
+  }
+}
+
+int roi_used(void) { return used; }
+
+void roi_open(Double (*instructions)(void)) {
+  count_instructions = instructions;
+  atexit(roi_close);
+}
+
+void roi_ecall(const Processor *processor, const Byte *memory) {
+  char name[sizeof(regions[0].name)];
+  int id;
+
+  used = 1;
+  switch (processor->R[10]) {
+  case ROI_BEGIN:
+    read_name(memory, processor->R[11], name, sizeof(name));
+    id = find_region(name, 1);
+    if (id >= 0) {
+      begin(id);
+    }
+    break;
+  case ROI_END:
+    if (processor->R[11] == 0) {
+      if (depth > 0) {
+        end(nesting[depth - 1]);
+      }
+      break;
+    }
+    read_name(memory, processor->R[11], name, sizeof(name));
+    id = find_region(name, 0);
+    if (id >= 0) {
+      end(id);
+    }
+    break;
+  case ROI_RESET:
+    reset();
+    break;
+  case ROI_DUMP:
+    if (count_instructions != NULL) {
+      print_regions();
+    }
+    break;
+  }
+}
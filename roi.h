@@ -0,0 +1,36 @@
+#ifndef ROI_H
+#define ROI_H
+
+#include "types.h"
+
+/* Regions of interest: ecalls a guest makes to measure part of itself.
+   Unlike the print ecalls they go on to the next instruction, and they
+   change no registers.
+
+     a0 = ROI_BEGIN  a1 = address of the region's name, NUL-terminated,
+                          or 0 for "roi"; regions nest, and a region
+                          entered again adds to its counts
+     a0 = ROI_END    a1 = the same name, or 0 for the innermost region
+     a0 = ROI_RESET  zeroes the counts; open regions count on from here
+     a0 = ROI_DUMP   prints the regions now
+
+   Each region counts its entries, the instructions executed in it, the
+   host cycles they took (see cycles.h; the simulator has no timing model
+   of its own) and, with SIM_STATS, their mix (see stats.h). The regions
+   are printed on stderr at exit. */
+#define ROI_BEGIN 0x100
+#define ROI_END 0x101
+#define ROI_RESET 0x102
+#define ROI_DUMP 0x103
+
+#define IS_ROI_ECALL(a0) ((a0) >= ROI_BEGIN && (a0) <= ROI_DUMP)
+
+/* Called by riscv.c with what counts its instructions; until then the
+   regions count none and are not printed. */
+void roi_open(Double (*instructions)(void));
+void roi_ecall(const Processor *processor, const Byte *memory);
+
+/* whether the guest has made any of these ecalls */
+int roi_used(void);
+
+#endif
@@ -0,0 +1,546 @@
+#define _GNU_SOURCE /* for pipe2() */
+#include "compare.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Runs the test matrix of driver.py (tests.json) and writes the same
+ * <directory>_Grade.json and LOG.md, but runs the parts of the matrix on a
+ * pool of worker threads and checks the outputs in-process:
+ *
+ *   python3 compare.py actual expected   compare_text_files()
+ *   python3 part2_tester.py name         compare_register_files() on
+ *                                        code/out/name.trace and
+ *                                        code/ref/name.trace
+ *
+ * Every other command goes to /bin/sh like in driver.py. The commands of
+ * a part run in order; the parts of the matrix run concurrently, so they
+ * must not depend on each other's output. The marks are the same as
+ * driver.py's; the log holds compare.c's reports instead of the Python
+ * scripts' output, unless -s runs the scripts too. */
+
+extern char **environ;
+
+typedef struct {
+  char *command;
+  long points;
+  int status; /* nonzero if the test failed */
+  char *output;
+  size_t output_length;
+} Test;
+
+typedef struct {
+  char *name;
+  Test *tests;
+  int count;
+} Part;
+
+typedef struct {
+  char *name;
+  Part *parts;
+  int count;
+} Group;
+
+static Group *groups = NULL;
+static int group_count = 0;
+
+/* the parts driver.py grades, in its order */
+static const char *part_names[] = {"Part1", "Part2"};
+#define PART_COUNT 2
+
+static Part **jobs;
+static int job_count, next_job = 0;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static int opt_shell = 0;
+
+/* ---- tests.json ---- */
+
+static const char *json, *json_start;
+static const char *json_name;
+
+static void json_error(const char *what) {
+  fprintf(stderr, "%s: %s at offset %ld\n", json_name, what,
+          (long)(json - json_start));
+  exit(2);
+}
+
+static void skip_space(void) {
+  while (*json == ' ' || *json == '\t' || *json == '\n' || *json == '\r') {
+    json++;
+  }
+}
+
+static void expect(char c) {
+  skip_space();
+  if (*json != c) {
+    char what[32];
+
+    snprintf(what, sizeof(what), "expected '%c'", c);
+    json_error(what);
+  }
+  json++;
+}
+
+/* Returns 1 and skips c if it comes next. */
+static int accept(char c) {
+  skip_space();
+  if (*json == c) {
+    json++;
+    return 1;
+  }
+  return 0;
+}
+
+static char *parse_string(void) {
+  char *text = malloc(strlen(json) + 1), *to = text;
+
+  expect('"');
+  while (*json != '"') {
+    if (*json == '\0') {
+      json_error("unterminated string");
+    }
+    if (*json == '\\') {
+      json++;
+      switch (*json) {
+      case 'n':
+        *to++ = '\n';
+        break;
+      case 't':
+        *to++ = '\t';
+        break;
+      case 'r':
+        *to++ = '\r';
+        break;
+      case 'u': {
+        /* the matrix is ASCII */
+        char hex[5] = {0};
+
+        strncpy(hex, json + 1, 4);
+        *to++ = strtol(hex, NULL, 16);
+        json += strlen(hex);
+        break;
+      }
+      default:
+        *to++ = *json;
+      }
+      json++;
+    } else {
+      *to++ = *json++;
+    }
+  }
+  json++;
+  *to = '\0';
+  return text;
+}
+
+static long parse_number(void) {
+  char *end;
+  long value;
+
+  skip_space();
+  value = strtol(json, &end, 10);
+  if (end == json) {
+    json_error("expected a number");
+  }
+  json = end;
+  return value;
+}
+
+/* { "command": points, ... } */
+static void parse_part(Part *part) {
+  expect('{');
+  if (accept('}')) {
+    return;
+  }
+  do {
+    Test *test;
+
+    part->tests = realloc(part->tests, (part->count + 1) * sizeof(Test));
+    test = &part->tests[part->count++];
+    memset(test, 0, sizeof(*test));
+    test->command = parse_string();
+    expect(':');
+    test->points = parse_number();
+  } while (accept(','));
+  expect('}');
+}
+
+/* { "Part1": {...}, "Part2": {...} } */
+static void parse_group(Group *group) {
+  expect('{');
+  if (accept('}')) {
+    return;
+  }
+  do {
+    Part *part;
+
+    group->parts = realloc(group->parts, (group->count + 1) * sizeof(Part));
+    part = &group->parts[group->count++];
+    memset(part, 0, sizeof(*part));
+    part->name = parse_string();
+    expect(':');
+    parse_part(part);
+  } while (accept(','));
+  expect('}');
+}
+
+static int load_matrix(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  char *text = NULL;
+  size_t size = 0;
+
+  if (file == NULL || getdelim(&text, &size, '\0', file) < 0) {
+    return -1;
+  }
+  fclose(file);
+  json = json_start = text;
+  json_name = filename;
+
+  expect('{');
+  if (!accept('}')) {
+    do {
+      Group *group;
+
+      groups = realloc(groups, (group_count + 1) * sizeof(Group));
+      group = &groups[group_count++];
+      memset(group, 0, sizeof(*group));
+      group->name = parse_string();
+      expect(':');
+      parse_group(group);
+    } while (accept(','));
+    expect('}');
+  }
+  free(text);
+  return 0;
+}
+
+static Part *find_part(Group *group, const char *name) {
+  int i;
+
+  for (i = 0; i < group->count; i++) {
+    if (strcmp(group->parts[i].name, name) == 0) {
+      return &group->parts[i];
+    }
+  }
+  return NULL;
+}
+
+/* ---- running the tests ---- */
+
+/* Runs command with /bin/sh, its stdout going to out and its stderr
+ * dropped like driver.py does. Returns its exit status. */
+static int run_shell(const char *command, FILE *out) {
+  char *argv[] = {"sh", "-c", (char *)command, NULL};
+  posix_spawn_file_actions_t actions;
+  char buffer[65536];
+  ssize_t n;
+  pid_t pid;
+  int fds[2], status, error;
+
+  /* close-on-exec, or commands started by other workers would hold the
+   * pipe open */
+  if (pipe2(fds, O_CLOEXEC) != 0) {
+    fprintf(out, "runtests: pipe: %s\n", strerror(errno));
+    return -1;
+  }
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  error = posix_spawn(&pid, "/bin/sh", &actions, NULL, argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(fds[1]);
+  if (error != 0) {
+    close(fds[0]);
+    fprintf(out, "runtests: /bin/sh: %s\n", strerror(error));
+    return -1;
+  }
+
+  while ((n = read(fds[0], buffer, sizeof(buffer))) != 0) {
+    if (n > 0) {
+      fwrite(buffer, 1, n, out);
+    } else if (errno != EINTR) {
+      break;
+    }
+  }
+  close(fds[0]);
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+}
+
+/* Checks a command calling one of the grading scripts in-process. Returns
+ * 0 if command is something else. */
+static int run_builtin(const char *command, FILE *out, int *status) {
+  char actual[4096], expected[4096], name[256], extra;
+  int result;
+
+  /* anything the shell would interpret goes to the shell */
+  if (opt_shell || strpbrk(command, "<>|;&$`'\"\\*?()[]{}~#") != NULL) {
+    return 0;
+  }
+  if (sscanf(command, " python3 compare.py %4095s %4095s %c", actual,
+             expected, &extra) == 2) {
+    result = compare_text_files(actual, expected, out);
+  } else if (sscanf(command, " python3 part2_tester.py %255s %c", name,
+                    &extra) == 1) {
+    /* see trace_format and max_num_instructions there */
+    snprintf(actual, sizeof(actual), "code/out/%s.trace", name);
+    snprintf(expected, sizeof(expected), "code/ref/%s.trace", name);
+    result = compare_register_files(actual, expected, 10000, out);
+  } else {
+    return 0;
+  }
+  *status = result != 0;
+  return 1;
+}
+
+static void run_part(Part *part) {
+  int i;
+
+  for (i = 0; i < part->count; i++) {
+    Test *test = &part->tests[i];
+    FILE *out = open_memstream(&test->output, &test->output_length);
+
+    if (!run_builtin(test->command, out, &test->status)) {
+      test->status = run_shell(test->command, out);
+    }
+    fclose(out);
+  }
+}
+
+static void *worker(void *arg) {
+  for (;;) {
+    Part *part;
+
+    pthread_mutex_lock(&job_lock);
+    part = next_job < job_count ? jobs[next_job++] : NULL;
+    pthread_mutex_unlock(&job_lock);
+    if (part == NULL) {
+      return NULL;
+    }
+    run_part(part);
+  }
+}
+
+/* ---- the output directory ---- */
+
+static int remove_entry(const char *path, const struct stat *st, int type,
+                        struct FTW *ftw) {
+  return remove(path);
+}
+
+static int make_directories(const char *path) {
+  char *copy = strdup(path), *slash = copy;
+  int result = 0;
+
+  while (result == 0 && (slash = strchr(slash + 1, '/')) != NULL) {
+    *slash = '\0';
+    if (mkdir(copy, 0777) != 0 && errno != EEXIST) {
+      result = -1;
+    }
+    *slash = '/';
+  }
+  if (result == 0 && mkdir(copy, 0777) != 0 && errno != EEXIST) {
+    result = -1;
+  }
+  free(copy);
+  return result;
+}
+
+/* ---- results ---- */
+
+/* a string the way Python's json.dumps() writes it */
+static void write_json_string(FILE *file, const char *text) {
+  fputc('"', file);
+  for (; *text != '\0'; text++) {
+    unsigned char c = *text;
+
+    if (c == '"' || c == '\\') {
+      fprintf(file, "\\%c", c);
+    } else if (c == '\n') {
+      fputs("\\n", file);
+    } else if (c < 0x20 || c >= 0x7f) {
+      fprintf(file, "\\u%04x", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+static void write_log_entry(FILE *file, const Test *test) {
+  fprintf(file, "### *****%s*****\n ```", test->command);
+  fwrite(test->output, 1, test->output_length, file);
+  fputs("\n```\n", file);
+}
+
+/* Writes <directory>_Grade.json and LOG.md. Returns 1 if a test failed. */
+static int write_results(void) {
+  char cwd[4096], filename[4200];
+  FILE *grade, *log;
+  int i, j, k, failed = 0, first = 1;
+
+  if (getcwd(cwd, sizeof(cwd)) == NULL) {
+    strcpy(cwd, ".");
+  }
+  snprintf(filename, sizeof(filename), "%s_Grade.json", basename(cwd));
+  grade = fopen(filename, "w");
+  log = fopen("LOG.md", "w");
+  if (grade == NULL || log == NULL) {
+    fprintf(stderr, "Cannot write %s or LOG.md\n", filename);
+    exit(2);
+  }
+
+  fputs("{", grade);
+  for (i = 0; i < group_count; i++) {
+    for (j = 0; j < PART_COUNT; j++) {
+      Part *part = find_part(&groups[i], part_names[j]);
+      long points = 0, total = 0;
+      char key[256], *c;
+
+      for (k = 0; k < part->count; k++) {
+        total += part->tests[k].points;
+        if (part->tests[k].status == 0) {
+          points += part->tests[k].points;
+        } else {
+          failed = 1;
+        }
+      }
+      snprintf(key, sizeof(key), "%s%s", groups[i].name, part_names[j]);
+      for (c = key; *c != '\0'; c++) {
+        if (*c >= 'A' && *c <= 'Z') {
+          *c += 'a' - 'A';
+        }
+      }
+      fprintf(grade, "%s\n  ", first ? "" : ",");
+      first = 0;
+      write_json_string(grade, key);
+      fprintf(grade, ": {\n    \"mark\": %ld,\n    \"comment\": \"%s\"\n  }",
+              points,
+              2 * points < total ? "Program did not run successfully. It "
+                                   "either did not build or exited with "
+                                   "error code 0"
+              : points < total   ? "Program ran, but output did not match. "
+                                   "see log file"
+                                 : "Program ran and output matched.");
+    }
+  }
+  fprintf(grade, "%s\n  \"userid\": ", first ? "" : ",");
+  snprintf(filename, sizeof(filename), "GithubID:%s", basename(cwd));
+  write_json_string(grade, filename);
+  fputs("\n}", grade);
+  fclose(grade);
+
+  /* the failures first, then the successes, each in the matrix order */
+  fprintf(log, "## ********************FAILED********************\n");
+  for (k = 0; k < 2; k++) {
+    if (k == 1) {
+      fprintf(log, "\n****************************************\n## "
+                   "********************SUCCESS********************\n");
+    }
+    for (i = 0; i < job_count; i++) {
+      for (j = 0; j < jobs[i]->count; j++) {
+        if ((jobs[i]->tests[j].status == 0) == k) {
+          write_log_entry(log, &jobs[i]->tests[j]);
+        }
+      }
+    }
+  }
+  fclose(log);
+  return failed;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-A] [-j jobs] [-f tests.json] [-s] -D output\n",
+          name);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  const char *output = NULL, *matrix = "tests.json";
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_t *workers;
+  char path[4096];
+  int c, i, j;
+
+  while ((c = getopt(argc, argv, "AD:j:f:s")) != -1) {
+    switch (c) {
+    case 'A':
+      /* accepted for compatibility with driver.py, which ignores it too */
+      break;
+    case 'D':
+      output = optarg;
+      break;
+    case 'j':
+      threads = strtol(optarg, NULL, 0);
+      break;
+    case 'f':
+      matrix = optarg;
+      break;
+    case 's':
+      opt_shell = 1;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (output == NULL || optind != argc) {
+    usage(argv[0]);
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  if (load_matrix(matrix) != 0) {
+    fprintf(stderr, "Cannot read %s\n", matrix);
+    return 2;
+  }
+  jobs = malloc(group_count * PART_COUNT * sizeof(Part *));
+  for (i = 0; i < group_count; i++) {
+    for (j = 0; j < PART_COUNT; j++) {
+      jobs[job_count] = find_part(&groups[i], part_names[j]);
+      if (jobs[job_count] == NULL) {
+        fprintf(stderr, "%s: %s has no %s\n", matrix, groups[i].name,
+                part_names[j]);
+        return 2;
+      }
+      job_count++;
+    }
+  }
+
+  nftw(output, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  for (i = 0; i < group_count; i++) {
+    snprintf(path, sizeof(path), "%s/%s", output, groups[i].name);
+    if (make_directories(path) != 0) {
+      fprintf(stderr, "Cannot create %s\n", path);
+      return 2;
+    }
+  }
+
+  if (threads > job_count) {
+    threads = job_count;
+  }
+  workers = malloc(threads * sizeof(pthread_t));
+  for (i = 0; i < threads; i++) {
+    pthread_create(&workers[i], NULL, worker, NULL);
+  }
+  for (i = 0; i < threads; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  return write_results();
+}
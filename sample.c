@@ -0,0 +1,70 @@
+#include "sample.h"
+#include "symbols.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+volatile Double sample_next = ~0ULL;
+
+static Double *samples = NULL; /* by pc / 4 */
+static Double every = 0;       /* 0 when the timer decides */
+static FILE *sample_file = NULL;
+
+void sample_take(Word pc, Double executed) {
+  if (pc < MEMORY_SPACE) {
+    samples[pc / 4]++;
+  }
+  sample_next = every != 0 ? executed + every : ~0ULL;
+}
+
+/* the sample is taken by the next instruction */
+static void on_timer(int signal) { sample_next = 0; }
+
+static void sample_close(void) {
+  struct itimerval off;
+  Address pc;
+
+  memset(&off, 0, sizeof(off));
+  setitimer(ITIMER_PROF, &off, NULL);
+  sample_next = ~0ULL;
+  for (pc = 0; pc < MEMORY_SPACE; pc += 4) {
+    if (samples[pc / 4] != 0) {
+      const char *name = symbols_lookup(pc, NULL);
+
+      if (name != NULL) {
+        fprintf(sample_file, "%s;", name);
+      }
+      fprintf(sample_file, "0x%08x %llu\n", pc,
+              (unsigned long long)samples[pc / 4]);
+    }
+  }
+  fclose(sample_file);
+}
+
+int sample_open(const char *filename, Double instructions, long timer_usec) {
+  samples = calloc(MEMORY_SPACE / 4, sizeof(Double));
+  sample_file = fopen(filename, "w");
+  if (samples == NULL || sample_file == NULL) {
+    return -1;
+  }
+  if (timer_usec != 0) {
+    struct sigaction action;
+    struct itimerval timer;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_timer;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &action, NULL);
+    timer.it_interval.tv_sec = timer_usec / 1000000;
+    timer.it_interval.tv_usec = timer_usec % 1000000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+  } else {
+    every = instructions;
+    sample_next = every;
+  }
+  atexit(sample_close);
+  return 0;
+}
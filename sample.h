@@ -0,0 +1,21 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "types.h"
+
+/* Sampling profile (--sample): the pc of every Nth instruction, or of the
+   next instruction after each SIGPROF of a CPU-time timer, is counted,
+   and at exit the counts are written in the folded-stack format flame
+   graph tools read: a `function;pc count` line per sampled pc, or just
+   `pc count` without symbols (see symbols.h). */
+
+/* execute() in riscv.c takes a sample once it has started this many
+   instructions; never while not sampling */
+extern volatile Double sample_next;
+
+/* every is in instructions, timer_usec in microseconds of CPU time; the
+   timer is used if it is not 0 */
+int sample_open(const char *filename, Double every, long timer_usec);
+void sample_take(Word pc, Double executed);
+
+#endif
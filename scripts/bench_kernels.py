@@ -0,0 +1,176 @@
+#!/usr/bin/python3
+#
+# bench_kernels.py - Assembles the benchmark kernels in code/bench.
+#
+# Each kernel repeats its loop body x11 times (`riscv -a 0,N`, N in hex) and
+# leaves through the exit ecall. The simulator's branches go on to the
+# instruction after a taken branch's target and skip the instruction after
+# a branch that is not taken, so branch targets and fall-throughs are
+# padded with nops: the kernels run the same loops whether or not that is
+# ever fixed.
+import os
+
+def r(f7, rs2, rs1, f3, rd):
+    return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | 0x33
+
+def i(imm, rs1, f3, rd, op=0x13):
+    return ((imm & 0xfff) << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op
+
+def s(imm, rs2, rs1, f3):
+    return (((imm >> 5) & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) | \
+        (f3 << 12) | ((imm & 0x1f) << 7) | 0x23
+
+def b_imm(imm, rs2, rs1, f3):
+    imm &= 0x1fff
+    return (((imm >> 12) & 1) << 31) | (((imm >> 5) & 0x3f) << 25) | \
+        (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (((imm >> 1) & 0xf) << 8) | \
+        (((imm >> 11) & 1) << 7) | 0x63
+
+def j_imm(imm, rd):
+    imm &= 0x1fffff
+    return (((imm >> 20) & 1) << 31) | (((imm >> 1) & 0x3ff) << 21) | \
+        (((imm >> 11) & 1) << 20) | (((imm >> 12) & 0xff) << 12) | (rd << 7) | 0x6f
+
+add = lambda rd, rs1, rs2: r(0, rs2, rs1, 0, rd)
+sub = lambda rd, rs1, rs2: r(0x20, rs2, rs1, 0, rd)
+mul = lambda rd, rs1, rs2: r(1, rs2, rs1, 0, rd)
+slt = lambda rd, rs1, rs2: r(0, rs2, rs1, 2, rd)
+xor = lambda rd, rs1, rs2: r(0, rs2, rs1, 4, rd)
+addi = lambda rd, rs1, imm: i(imm, rs1, 0, rd)
+slli = lambda rd, rs1, sh: i(sh, rs1, 1, rd)
+xori = lambda rd, rs1, imm: i(imm, rs1, 4, rd)
+srli = lambda rd, rs1, sh: i(sh, rs1, 5, rd)
+srai = lambda rd, rs1, sh: i(0x400 | sh, rs1, 5, rd)
+ori = lambda rd, rs1, imm: i(imm, rs1, 6, rd)
+andi = lambda rd, rs1, imm: i(imm, rs1, 7, rd)
+lb = lambda rd, imm, rs1: i(imm, rs1, 0, rd, 0x03)
+lh = lambda rd, imm, rs1: i(imm, rs1, 1, rd, 0x03)
+lw = lambda rd, imm, rs1: i(imm, rs1, 2, rd, 0x03)
+sb = lambda rs2, imm, rs1: s(imm, rs2, rs1, 0)
+sh = lambda rs2, imm, rs1: s(imm, rs2, rs1, 1)
+sw = lambda rs2, imm, rs1: s(imm, rs2, rs1, 2)
+lui = lambda rd, imm: ((imm & 0xfffff) << 12) | (rd << 7) | 0x37
+nop = lambda: addi(0, 0, 0)
+ecall = lambda: 0x73
+
+# branches and jumps to labels, resolved by assemble()
+beq = lambda rs1, rs2, label: ("b", 0, rs1, rs2, label)
+bne = lambda rs1, rs2, label: ("b", 1, rs1, rs2, label)
+blt = lambda rs1, rs2, label: ("b", 4, rs1, rs2, label)
+bge = lambda rs1, rs2, label: ("b", 5, rs1, rs2, label)
+jal = lambda rd, label: ("j", rd, label)
+
+def assemble(program):
+    labels, address = {}, 0
+    for item in program:
+        if isinstance(item, str):
+            labels[item] = address
+        else:
+            address += 4
+    words, address = [], 0
+    for item in program:
+        if isinstance(item, str):
+            continue
+        if isinstance(item, tuple) and item[0] == "b":
+            _, f3, rs1, rs2, label = item
+            item = b_imm(labels[label] - address, rs2, rs1, f3)
+        elif isinstance(item, tuple):
+            _, rd, label = item
+            item = j_imm(labels[label] - address, rd)
+        words.append(item)
+        address += 4
+    return words
+
+def kernel(setup, body):
+    """x5 counts the iterations down from x11."""
+    return setup + [
+        addi(5, 11, 0),
+        "loop", nop(),
+        beq(5, 0, "done"), nop(),
+    ] + body + [
+        addi(5, 5, -1),
+        jal(0, "loop"),
+        "done", nop(),
+        addi(10, 0, 10),
+        ecall(),
+    ]
+
+KERNELS = {
+    # multiply.input's repeated-addition multiply, 14 * 27 per iteration
+    "multiply": kernel([], [
+        addi(8, 0, 14),
+        addi(9, 0, 27),
+        "inner", nop(),
+        beq(8, 0, "inner_done"), nop(),
+        add(18, 18, 9),
+        addi(8, 8, -1),
+        jal(0, "inner"),
+        "inner_done", nop(),
+    ]),
+    # mac.input's multiply-accumulate through memory
+    "mac": kernel([addi(12, 0, 10), addi(13, 0, 5), lui(6, 0x10)], [
+        mul(13, 5, 13),
+        sw(13, 0, 6),
+        lw(14, 0, 6),
+        add(13, 14, 12),
+        andi(13, 13, 0x7ff),
+    ]),
+    # random.input's mix of sub-word memory accesses, shifts and compares
+    "random": kernel([lui(6, 0x10)], [
+        lui(7, 0xfffff),
+        ori(7, 7, 0x7ff),
+        sb(7, 0, 6),
+        sh(7, 1, 6),
+        xori(7, 7, 0x7ff),
+        lb(8, 0, 6),
+        lh(9, 1, 6),
+        srai(7, 7, 31),
+        slt(10, 7, 0),
+        add(7, 7, 10),
+        srli(10, 5, 1),
+        sub(18, 9, 8),
+    ]),
+    # copies and sums a 64 KB buffer per iteration, a word at a time
+    "stream": kernel([lui(20, 0x20), lui(21, 0x30)], [
+        addi(6, 20, 0),
+        addi(7, 21, 0),
+        lui(28, 0x10),
+        add(28, 28, 20),
+        "copy", nop(),
+        bge(6, 28, "copied"), nop(),
+        lw(8, 0, 6),
+        add(18, 18, 8),
+        sw(18, 0, 7),
+        addi(6, 6, 4),
+        addi(7, 7, 4),
+        jal(0, "copy"),
+        "copied", nop(),
+    ]),
+    # data-dependent branches on a xorshift generator
+    "branch": kernel([lui(8, 0x12345), ori(8, 8, 0x678), addi(12, 0, 4)], [
+        slli(9, 8, 13),
+        xor(8, 8, 9),
+        srli(9, 8, 17),
+        xor(8, 8, 9),
+        slli(9, 8, 5),
+        xor(8, 8, 9),
+        andi(9, 8, 1),
+        beq(9, 0, "even"), nop(),
+        addi(18, 18, 1),
+        "even", nop(),
+        andi(9, 8, 6),
+        blt(9, 12, "small"), nop(),
+        addi(19, 19, 1),
+        "small", nop(),
+        bne(9, 0, "nonzero"), nop(),
+        addi(20, 20, 1),
+        "nonzero", nop(),
+    ]),
+}
+
+if __name__ == "__main__":
+    out = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "code", "bench")
+    os.makedirs(out, exist_ok=True)
+    for name, program in KERNELS.items():
+        with open(os.path.join(out, name + ".input"), "w") as f:
+            f.write("".join("%08x\n" % w for w in assemble(program)))
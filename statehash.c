@@ -0,0 +1,122 @@
+#include "statehash.h"
+#include "trace.h"
+#include "tracestream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int statehash_active = 0;
+
+/* The hash of a state is the sum of a mix of each of its parts, so a store
+ * or a register write updates it with a subtraction and an addition
+ * instead of hashing the whole state again. Memory contributes the
+ * difference to its initial contents, which both runs share. The hash of
+ * each state is then folded into a rolling hash of the run so far. */
+static Double memory_sum = 0, register_sum = 0, rolling = 0;
+static Processor last_state; /* after the last instruction */
+static Double executed = 0, hashed = 0, interval = 1;
+static FILE *statehash_file = NULL;
+
+/* splitmix64's finalizer */
+static Double mix(Double x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* the parts are told apart by their keys: registers and the pc below
+ * 2^38, memory bytes from 2^63 */
+static Double mix_register(int i, Word value) {
+  return mix((Double)(i + 1) << 32 | value);
+}
+
+static Double mix_byte(Address address, Byte value) {
+  return mix(1ULL << 63 | (Double)address << 8 | value);
+}
+
+static void write_record(void) {
+  StateHashRecord record;
+
+  record.instructions = executed;
+  record.hash = rolling;
+  fwrite(&record, sizeof(record), 1, statehash_file);
+  hashed = executed;
+}
+
+/* The instruction that ended the simulation, if any, changed nothing, so
+ * the run ends in the state after the last one completed. Left out of
+ * windows set by a trace filter. */
+static void statehash_close(void) {
+  if (!trace_filtering && executed != hashed) {
+    write_record();
+  }
+  fclose(statehash_file);
+  statehash_active = 0;
+}
+
+int statehash_open(const char *filename, const Processor *processor,
+                   int codec, Double every) {
+  StateHashHeader header;
+  int i;
+
+  statehash_file = trace_stream_open_write(filename, codec);
+  if (statehash_file == NULL) {
+    return -1;
+  }
+  setvbuf(statehash_file, NULL, _IOFBF, 1 << 16);
+  interval = every > 0 ? every : 1;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, STATEHASH_MAGIC, 4);
+  header.version = STATEHASH_VERSION;
+  header.record_size = sizeof(StateHashRecord);
+  header.interval = interval;
+  fwrite(&header, sizeof(header), 1, statehash_file);
+
+  last_state = *processor;
+  register_sum = mix_register(32, processor->PC);
+  for (i = 0; i < 32; i++) {
+    register_sum += mix_register(i, processor->R[i]);
+  }
+  statehash_active = 1;
+  atexit(statehash_close);
+  return 0;
+}
+
+/* Called by store() before memory changes. */
+void statehash_store(const Byte *memory, Address address, Alignment alignment,
+                     Word value) {
+  int i;
+
+  for (i = 0; i < alignment; i++) {
+    Byte old = memory[address + i], new = value >> (8 * i);
+
+    if (old != new) {
+      memory_sum += mix_byte(address + i, new) - mix_byte(address + i, old);
+    }
+  }
+}
+
+void statehash_step(const Processor *processor, int traced) {
+  int i;
+
+  /* most instructions change one register and the pc */
+  for (i = 1; i < 32; i++) {
+    if (processor->R[i] != last_state.R[i]) {
+      register_sum += mix_register(i, processor->R[i]) -
+                      mix_register(i, last_state.R[i]);
+      last_state.R[i] = processor->R[i];
+    }
+  }
+  register_sum += mix_register(32, processor->PC) -
+                  mix_register(32, last_state.PC);
+  last_state.PC = processor->PC;
+
+  rolling = mix(rolling ^ (register_sum + memory_sum));
+  executed++;
+  if (traced && executed % interval == 0) {
+    write_record();
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef STATEHASH_H
+#define STATEHASH_H
+
+#include "types.h"
+
+/* State-hash streams are a StateHashHeader followed by a StateHashRecord
+   every interval instructions, and one more for the state the simulation
+   ended in. A record holds a rolling hash of the architectural state (the
+   pc, the registers and every byte of memory stored to) after each
+   instruction so far, so two runs of the same program match record for
+   record until they diverge, and differ in every record after that.
+   `hashcmp` compares two streams and narrows a divergence down to one
+   instruction. Everything is written in host (little-endian) byte order. */
+#define STATEHASH_MAGIC "RVTH"
+#define STATEHASH_VERSION 1
+
+typedef struct {
+    char magic[4];
+    Half version;
+    Half record_size;
+    Double interval;
+} StateHashHeader;
+
+typedef struct {
+    Double instructions; /* executed before the state was hashed */
+    Double hash;
+} StateHashRecord;
+
+/* set while a stream is being written, see execute() in riscv.c */
+extern int statehash_active;
+
+/* codec is one of the TRACE_CODEC_* values in tracestream.h. The stream
+   follows the trace filter: records only come after traced instructions. */
+int statehash_open(const char *filename, const Processor *processor,
+                   int codec, Double interval);
+void statehash_store(const Byte *memory, Address address, Alignment alignment,
+                     Word value);
+void statehash_step(const Processor *processor, int traced);
+
+#endif
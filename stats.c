@@ -0,0 +1,97 @@
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef SIM_STATS
+Double stats_counts[STAT_EVENTS];
+
+static const char *const names[STAT_MNEMONICS] = {
+    "add",  "sub",  "mul",  "mulh", "sll",  "slt",  "xor",   "div",
+    "srl",  "sra",  "or",   "rem",  "and",  "addi", "slli",  "slti",
+    "xori", "srli", "srai", "ori",  "andi", "lui",  "lb",    "lh",
+    "lw",   "sb",   "sh",   "sw",   "beq",  "bne",  "blt",   "bge",
+    "jal",  "ecall", "csr", "invalid"};
+
+/* the mnemonics of each category, first to last */
+static const struct {
+  const char *name;
+  int first, last;
+} categories[] = {
+    {"alu", STAT_ADD, STAT_LUI},       {"load", STAT_LB, STAT_LW},
+    {"store", STAT_SB, STAT_SW},       {"branch", STAT_BEQ, STAT_BGE},
+    {"jump", STAT_JAL, STAT_JAL},      {"ecall", STAT_ECALL, STAT_ECALL},
+    {"csr", STAT_CSR, STAT_CSR},       {"invalid", STAT_INVALID, STAT_INVALID}};
+
+static FILE *stats_file = NULL;
+
+static int by_count(const void *a, const void *b) {
+  Double x = stats_counts[*(const int *)a], y = stats_counts[*(const int *)b];
+
+  return (x < y) - (x > y);
+}
+
+static double percent(Double count, Double total) {
+  return total != 0 ? 100.0 * count / total : 0;
+}
+
+void stats_print_categories(FILE *out, const Double *counts,
+                            const char *indent) {
+  Double total = 0;
+  int i, j;
+
+  for (i = 0; i < STAT_MNEMONICS; i++) {
+    total += counts[i];
+  }
+  for (i = 0; i < (int)(sizeof(categories) / sizeof(categories[0])); i++) {
+    Double count = 0;
+
+    for (j = categories[i].first; j <= categories[i].last; j++) {
+      count += counts[j];
+    }
+    fprintf(out, "%s%-8s %12llu %6.2f%%\n", indent, categories[i].name,
+            (unsigned long long)count, percent(count, total));
+  }
+  fprintf(out, "%sbranches taken %llu, not taken %llu (%.2f%% taken)\n",
+          indent, (unsigned long long)counts[STAT_TAKEN],
+          (unsigned long long)counts[STAT_NOT_TAKEN],
+          percent(counts[STAT_TAKEN],
+                  counts[STAT_TAKEN] + counts[STAT_NOT_TAKEN]));
+}
+
+static void stats_close(void) {
+  int order[STAT_MNEMONICS], i;
+  Double total = 0;
+
+  for (i = 0; i < STAT_MNEMONICS; i++) {
+    order[i] = i;
+    total += stats_counts[i];
+  }
+  qsort(order, STAT_MNEMONICS, sizeof(int), by_count);
+
+  fflush(stdout);
+  fprintf(stats_file, "instruction mix: %llu instructions\n",
+          (unsigned long long)total);
+  stats_print_categories(stats_file, stats_counts, "  ");
+  for (i = 0; i < STAT_MNEMONICS && stats_counts[order[i]] != 0; i++) {
+    fprintf(stats_file, "  %-8s %12llu %6.2f%%\n", names[order[i]],
+            (unsigned long long)stats_counts[order[i]],
+            percent(stats_counts[order[i]], total));
+  }
+  if (stats_file != stderr) {
+    fclose(stats_file);
+  }
+}
+#endif
+
+int stats_open(const char *filename) {
+#ifdef SIM_STATS
+  stats_file = filename != NULL ? fopen(filename, "w") : stderr;
+  if (stats_file == NULL) {
+    return -1;
+  }
+  atexit(stats_close);
+  return 0;
+#else
+  return -1;
+#endif
+}
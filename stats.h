@@ -0,0 +1,45 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "types.h"
+#include <stdio.h>
+
+/* Instruction mix (--stats): the handlers in part2.c and engine.c count
+   every instruction they execute by mnemonic, and branches by outcome,
+   and the counts and their totals by category are printed at exit. The
+   counters are only compiled in with -DSIM_STATS (the Makefile's default,
+   `make STATS=0` leaves them out); without them they cost nothing and
+   --stats is refused. */
+enum {
+    STAT_ADD, STAT_SUB, STAT_MUL, STAT_MULH, STAT_SLL, STAT_SLT, STAT_XOR,
+    STAT_DIV, STAT_SRL, STAT_SRA, STAT_OR, STAT_REM, STAT_AND,
+    STAT_ADDI, STAT_SLLI, STAT_SLTI, STAT_XORI, STAT_SRLI, STAT_SRAI,
+    STAT_ORI, STAT_ANDI, STAT_LUI,
+    STAT_LB, STAT_LH, STAT_LW, STAT_SB, STAT_SH, STAT_SW,
+    STAT_BEQ, STAT_BNE, STAT_BLT, STAT_BGE, STAT_JAL,
+    STAT_ECALL, STAT_CSR, STAT_INVALID,
+    STAT_MNEMONICS,
+    /* conditional branches by outcome */
+    STAT_TAKEN = STAT_MNEMONICS, STAT_NOT_TAKEN,
+    STAT_EVENTS
+};
+
+#ifdef SIM_STATS
+extern Double stats_counts[STAT_EVENTS];
+
+/* the totals by category of a copy of stats_counts, or of a difference
+   of two, a line each */
+void stats_print_categories(FILE *out, const Double *counts,
+                            const char *indent);
+#define STATS_COUNT(event) ((void)stats_counts[event]++)
+#define STATS_BRANCH(taken) STATS_COUNT((taken) ? STAT_TAKEN : STAT_NOT_TAKEN)
+#else
+#define STATS_COUNT(event) ((void)0)
+#define STATS_BRANCH(taken) ((void)0)
+#endif
+
+/* the counts go to filename, or to stderr if it is NULL; fails without
+   SIM_STATS */
+int stats_open(const char *filename);
+
+#endif
@@ -0,0 +1,75 @@
+#include "symbols.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  Address address;
+  char *name;
+} Symbol;
+
+static Symbol *symbols = NULL;
+static int symbol_count = 0;
+
+static int by_address(const void *a, const void *b) {
+  Address x = ((const Symbol *)a)->address, y = ((const Symbol *)b)->address;
+
+  return (x > y) - (x < y);
+}
+
+int symbols_load(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  char line[256];
+  int capacity = 0;
+
+  if (file == NULL) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char *end, *name, *last = NULL;
+    Address address = strtoul(line, &end, 16);
+
+    if (end == line) {
+      continue;
+    }
+    /* the name is the last word on the line */
+    for (name = strtok(end, " \t\r\n"); name != NULL;
+         name = strtok(NULL, " \t\r\n")) {
+      last = name;
+    }
+    if (last == NULL) {
+      continue;
+    }
+    if (symbol_count == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      symbols = realloc(symbols, capacity * sizeof(Symbol));
+    }
+    symbols[symbol_count].address = address;
+    symbols[symbol_count++].name = strdup(last);
+  }
+  fclose(file);
+  qsort(symbols, symbol_count, sizeof(Symbol), by_address);
+  return 0;
+}
+
+const char *symbols_lookup(Address pc, Address *start) {
+  int low = 0, high = symbol_count;
+
+  /* the first symbol after pc */
+  while (low < high) {
+    int middle = (low + high) / 2;
+
+    if (symbols[middle].address <= pc) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == 0) {
+    return NULL;
+  }
+  if (start != NULL) {
+    *start = symbols[low - 1].address;
+  }
+  return symbols[low - 1].name;
+}
@@ -0,0 +1,15 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include "types.h"
+
+/* Function names for the profilers' reports. Programs are bare words, so
+   the names come from a file of `address name` lines, addresses in hex;
+   `nm` output, with its type letters, reads the same. */
+int symbols_load(const char *filename);
+
+/* The name of the last symbol at or before pc, and its address in start,
+   or NULL if there is none or no symbols were loaded. */
+const char *symbols_lookup(Address pc, Address *start);
+
+#endif
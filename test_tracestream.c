@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cunit/Basic.h>
+
+#include "tracestream.h"
+#include "types.h"
+
+void test_lz_round_trip();
+void test_lz_incompressible();
+void test_lz_malformed();
+
+int main(int arc, char **argv) {
+    CU_pSuite pSuite1 = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    pSuite1 = CU_add_suite("Testing the trace LZ codec", NULL, NULL);
+    if (!pSuite1) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_lz_round_trip", test_lz_round_trip)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_lz_incompressible", test_lz_incompressible)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_lz_malformed", test_lz_malformed)) {
+        goto exit;
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+    exit:
+    CU_cleanup_registry();
+    return CU_get_error();
+}
+
+void test_lz_round_trip() {
+    static Byte in[100000], packed[100000 + 100000 / 255 + 16], out[100000];
+    int i, packed_size;
+
+    /* trace-like records: mostly repeated with a counter changing */
+    for (i = 0; i < (int)sizeof(in); i++) {
+        in[i] = (i % 24 < 4) ? (Byte)(i / 24) : (Byte)(i % 24);
+    }
+    packed_size = lz_compress(in, sizeof(in), packed, sizeof(packed));
+    CU_ASSERT(packed_size > 0);
+    CU_ASSERT(packed_size < (int)sizeof(in) / 2);
+    CU_ASSERT_EQUAL(lz_decompress(packed, packed_size, out, sizeof(out)), sizeof(in));
+    CU_ASSERT(memcmp(in, out, sizeof(in)) == 0);
+
+    /* long runs need the extended match lengths */
+    memset(in, 'r', sizeof(in));
+    packed_size = lz_compress(in, sizeof(in), packed, sizeof(packed));
+    CU_ASSERT(packed_size > 0 && packed_size < 1000);
+    CU_ASSERT_EQUAL(lz_decompress(packed, packed_size, out, sizeof(out)), sizeof(in));
+    CU_ASSERT(memcmp(in, out, sizeof(in)) == 0);
+
+    packed_size = lz_compress(in, 3, packed, sizeof(packed));
+    CU_ASSERT_EQUAL(lz_decompress(packed, packed_size, out, sizeof(out)), 3);
+    packed_size = lz_compress(in, 0, packed, sizeof(packed));
+    CU_ASSERT_EQUAL(lz_decompress(packed, packed_size, out, sizeof(out)), 0);
+}
+
+void test_lz_incompressible() {
+    static Byte in[5000], packed[5000 + 5000 / 255 + 16], out[5000];
+    int i, packed_size;
+
+    srand(295);
+    for (i = 0; i < (int)sizeof(in); i++) {
+        in[i] = rand();
+    }
+    packed_size = lz_compress(in, sizeof(in), packed, lz_compress_bound(sizeof(in)));
+    CU_ASSERT(packed_size > 0);
+    CU_ASSERT_EQUAL(lz_decompress(packed, packed_size, out, sizeof(out)), sizeof(in));
+    CU_ASSERT(memcmp(in, out, sizeof(in)) == 0);
+
+    /* too small an output buffer is reported, not overrun */
+    CU_ASSERT_EQUAL(lz_compress(in, sizeof(in), packed, 100), -1);
+}
+
+void test_lz_malformed() {
+    Byte out[64];
+    /* a match reaching back before the start of the output */
+    Byte bad_offset[] = {0x10, 'a', 0x05, 0x00};
+    /* a literal run longer than the input */
+    Byte truncated[] = {0xF0, 0x20, 'a'};
+
+    CU_ASSERT_EQUAL(lz_decompress(bad_offset, sizeof(bad_offset), out, sizeof(out)), -1);
+    CU_ASSERT_EQUAL(lz_decompress(truncated, sizeof(truncated), out, sizeof(out)), -1);
+}
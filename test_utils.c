@@ -4,6 +4,8 @@
 
 #include "utils.h"
 #include "types.h"
+#include "riscv.h"
+#include "csr.h"
 
 void test_sign_extend_number();
 void test_parse_instruction_rtype();
@@ -12,9 +14,11 @@ void test_parse_instruction_stype();
 void test_parse_instruction_sbtype();
 void test_parse_instruction_ujtype();
 void test_parse_instruction_utype();
+void test_disassemble_csr();
+void test_execute_csr();
 
 int main(int arc, char **argv) {
-    CU_pSuite pSuite1 = NULL;
+    CU_pSuite pSuite1 = NULL, pSuite2 = NULL;
 
     if (CUE_SUCCESS != CU_initialize_registry()) {
         return CU_get_error();
@@ -53,6 +57,19 @@ int main(int arc, char **argv) {
         goto exit;
     }
 
+    pSuite2 = CU_add_suite("Testing the Zicsr counters", NULL, NULL);
+    if (!pSuite2) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite2, "test_disassemble_csr", test_disassemble_csr)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite2, "test_execute_csr", test_execute_csr)) {
+        goto exit;
+    }
+
 
 
     CU_basic_set_mode(CU_BRM_VERBOSE);
@@ -130,3 +147,54 @@ void test_parse_instruction_ujtype() {
     CU_ASSERT_EQUAL(inst.ujtype.rd, 1);
     CU_ASSERT_EQUAL(inst.ujtype.imm, 0);
 }
+
+void test_disassemble_csr() {
+    char line[DISASM_LINE_SIZE];
+
+    /* COUNTER_FORMAT: csrrs rd, counter, x0 */
+    disassemble_instruction(line, 0xc00022f3);
+    CU_ASSERT_STRING_EQUAL(line, "rdcycle\tx5\n");
+    disassemble_instruction(line, 0xc0102373);
+    CU_ASSERT_STRING_EQUAL(line, "rdtime\tx6\n");
+    disassemble_instruction(line, 0xc8202573);
+    CU_ASSERT_STRING_EQUAL(line, "rdinstreth\tx10\n");
+
+    /* CSR_FORMAT */
+    disassemble_instruction(line, 0xc01035f3);
+    CU_ASSERT_STRING_EQUAL(line, "csrrc\tx11, time, x0\n");
+    disassemble_instruction(line, 0x30011073);
+    CU_ASSERT_STRING_EQUAL(line, "csrrw\tx0, 0x300, x2\n");
+
+    /* CSRI_FORMAT */
+    disassemble_instruction(line, 0xc02064f3);
+    CU_ASSERT_STRING_EQUAL(line, "csrrsi\tx9, instret, 0\n");
+    disassemble_instruction(line, 0xc80fd7f3);
+    CU_ASSERT_STRING_EQUAL(line, "csrrwi\tx15, cycleh, 31\n");
+}
+
+static Double instructions;
+
+static Double instructions_started(void) {
+    return instructions;
+}
+
+void test_execute_csr() {
+    Processor processor = {{0}, 0x1000};
+
+    /* the instruction reading the counter is not retired yet */
+    csr_open(instructions_started);
+    instructions = 0x100000005ULL;
+    CU_ASSERT_EQUAL(csr_execute(parse_instruction(0xc02022f3), &processor), 0);
+    CU_ASSERT_EQUAL(processor.R[5], 4);
+    CU_ASSERT_EQUAL(processor.PC, 0x1004);
+    CU_ASSERT_EQUAL(csr_execute(parse_instruction(0xc0002373), &processor), 0);
+    CU_ASSERT_EQUAL(processor.R[6], 4);
+    CU_ASSERT_EQUAL(csr_execute(parse_instruction(0xc82023f3), &processor), 0);
+    CU_ASSERT_EQUAL(processor.R[7], 1);
+
+    /* writes and unknown CSRs are invalid and change nothing */
+    CU_ASSERT_EQUAL(csr_execute(parse_instruction(0xc0011073), &processor), -1);
+    CU_ASSERT_EQUAL(csr_execute(parse_instruction(0x300022f3), &processor), -1);
+    CU_ASSERT_EQUAL(processor.R[5], 4);
+    CU_ASSERT_EQUAL(processor.PC, 0x100c);
+}
@@ -0,0 +1,634 @@
+#include "trace.h"
+#include "memtrace.h"
+#include "riscv.h"
+#include "tracestream.h"
+#include "utils.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int trace_active = 0;
+
+static FILE *trace_file = NULL; /* binary trace, see trace_open_binary() */
+static FILE *delta_file = NULL; /* delta trace, see trace_open_delta() */
+static FILE *text_file = NULL;  /* -r/-t text, see trace_open_text() */
+static int memory_trace = 0; /* see trace_open_memory() */
+static TraceRecord current;
+static int in_flight = 0; /* between trace_begin() and trace_end() */
+
+/* the delta trace's view of the register file, and the console output of
+ * the current instruction */
+static Register delta_R[32];
+static char *delta_output = NULL;
+static int delta_output_length = 0, delta_output_size = 0;
+
+static TraceFormatter text_format;
+
+/* the register file as the records written so far describe it */
+static Register traced_R[32];
+
+/* ---- asynchronous writer ----
+ *
+ * With trace_start_async() the simulation thread only pushes records into a
+ * single-producer/single-consumer ring and a writer thread formats and
+ * writes them. head is only written by the producer and tail only by the
+ * consumer, so each side needs nothing more than acquire/release ordering
+ * on the other's index. When the ring is full the producer waits for the
+ * writer to catch up. */
+
+#define RING_SIZE (1 << 16) /* records, a power of two */
+
+static struct {
+  TraceRecord slots[RING_SIZE];
+  _Atomic size_t head; /* next slot the producer fills */
+  _Atomic size_t tail; /* next slot the consumer drains */
+  atomic_int done;
+  size_t cached_tail; /* producer's last view of tail */
+  pthread_t writer;
+  int running;
+  FILE *stats;
+  /* statistics, kept by the producer */
+  Double pushes, stalls, stall_spins, occupancy_sum;
+  size_t max_occupancy;
+} ring;
+
+static void emit(const TraceRecord *record);
+
+static void *writer_main(void *unused) {
+  size_t tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+
+  for (;;) {
+    size_t head = atomic_load_explicit(&ring.head, memory_order_acquire);
+
+    if (head == tail) {
+      if (atomic_load_explicit(&ring.done, memory_order_acquire) &&
+          head == atomic_load_explicit(&ring.head, memory_order_acquire)) {
+        break;
+      }
+      sched_yield();
+      continue;
+    }
+    /* drain everything published so far before releasing the slots */
+    while (tail != head) {
+      emit(&ring.slots[tail & (RING_SIZE - 1)]);
+      tail++;
+      if ((tail & 255) == 0) {
+        atomic_store_explicit(&ring.tail, tail, memory_order_release);
+      }
+    }
+    atomic_store_explicit(&ring.tail, tail, memory_order_release);
+  }
+  return NULL;
+}
+
+static void ring_push(const TraceRecord *record) {
+  size_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+  size_t occupancy;
+
+  /* the writer's tail is only read when the ring looks full, and now and
+   * then to keep the occupancy statistics honest */
+  if ((head & 63) == 0) {
+    ring.cached_tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+  }
+  occupancy = head - ring.cached_tail;
+  if (occupancy >= RING_SIZE) {
+    ring.cached_tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+    occupancy = head - ring.cached_tail;
+    if (occupancy >= RING_SIZE) {
+      ring.stalls++;
+      do {
+        ring.stall_spins++;
+        sched_yield();
+        ring.cached_tail =
+            atomic_load_explicit(&ring.tail, memory_order_acquire);
+      } while (head - ring.cached_tail >= RING_SIZE);
+      occupancy = head - ring.cached_tail;
+    }
+  }
+
+  ring.slots[head & (RING_SIZE - 1)] = *record;
+  atomic_store_explicit(&ring.head, head + 1, memory_order_release);
+
+  ring.pushes++;
+  ring.occupancy_sum += occupancy;
+  if (occupancy > ring.max_occupancy) {
+    ring.max_occupancy = occupancy;
+  }
+}
+
+/* Moves formatting and writing of every open trace to a writer thread. */
+int trace_start_async(FILE *stats) {
+  atomic_store(&ring.head, 0);
+  atomic_store(&ring.tail, 0);
+  atomic_store(&ring.done, 0);
+  if (pthread_create(&ring.writer, NULL, writer_main, NULL) != 0) {
+    return -1;
+  }
+  ring.running = 1;
+  ring.stats = stats;
+  return 0;
+}
+
+/* Prints how full the ring ran and how often the simulation had to wait
+ * for the writer. */
+static void print_async_stats(FILE *out) {
+  fprintf(out, "trace ring: %llu records, %d slots\n",
+          (unsigned long long)ring.pushes, RING_SIZE);
+  fprintf(out, "trace ring: occupancy average %.1f, max %zu\n",
+          ring.pushes ? (double)ring.occupancy_sum / ring.pushes : 0.0,
+          ring.max_occupancy);
+  fprintf(out, "trace ring: %llu stalls, %llu yields waiting for space\n",
+          (unsigned long long)ring.stalls,
+          (unsigned long long)ring.stall_spins);
+}
+
+static void stop_async(void) {
+  if (!ring.running) {
+    return;
+  }
+  atomic_store_explicit(&ring.done, 1, memory_order_release);
+  pthread_join(ring.writer, NULL);
+  ring.running = 0;
+  if (ring.stats != NULL) {
+    print_async_stats(ring.stats);
+  }
+}
+
+/* ---- sinks ---- */
+
+static int console_to_trace(const char *text, int length);
+
+static void start_tracing(const Processor *processor) {
+  static int registered = 0;
+
+  memcpy(traced_R, processor->R, sizeof(traced_R));
+  trace_active = 1;
+  console_hook = console_to_trace;
+  /* flush from an atexit() handler since the guest usually leaves through
+   * the exit ecall */
+  if (!registered) {
+    atexit(trace_close);
+    registered = 1;
+  }
+}
+
+/* Opens filename, compressed with codec unless that is TRACE_CODEC_NONE,
+ * and writes the header describing the initial state. */
+int trace_open_binary(const char *filename, const Processor *processor,
+                      int codec) {
+  TraceHeader header;
+
+  trace_file = trace_stream_open_write(filename, codec);
+  if (trace_file == NULL) {
+    return -1;
+  }
+  setvbuf(trace_file, NULL, _IOFBF, 1 << 16);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_MAGIC, 4);
+  header.version = TRACE_VERSION;
+  header.record_size = sizeof(TraceRecord);
+  memcpy(header.R, processor->R, sizeof(header.R));
+  header.PC = processor->PC;
+  fwrite(&header, sizeof(header), 1, trace_file);
+
+  start_tracing(processor);
+  return 0;
+}
+
+/* Opens filename and writes the full register file, after which only the
+ * changes made by each instruction are printed. */
+int trace_open_delta(const char *filename, const Processor *processor,
+                     int codec) {
+  delta_file = trace_stream_open_write(filename, codec);
+  if (delta_file == NULL) {
+    return -1;
+  }
+  setvbuf(delta_file, NULL, _IOFBF, 1 << 16);
+
+  memcpy(delta_R, processor->R, sizeof(delta_R));
+  print_registers(delta_file, delta_R);
+
+  start_tracing(processor);
+  return 0;
+}
+
+/* Prints the -r (regdump) and -t (disasm) text trace to out through the
+ * trace records instead of directly from execute(). The console output of
+ * the guest goes through the records as well to stay in order. */
+int trace_open_text(FILE *out, const Processor *processor, int regdump,
+                    int disasm) {
+  text_file = out;
+  trace_format_init(&text_format, processor->R, regdump, disasm);
+  start_tracing(processor);
+  return 0;
+}
+
+/* Writes every load and store, and with fetches every instruction fetch,
+ * to a memory-access trace, see memtrace.h. */
+int trace_open_memory(const char *filename, const Processor *processor,
+                      int codec, int fetches) {
+  if (memtrace_open(filename, codec, fetches) != 0) {
+    return -1;
+  }
+  memory_trace = 1;
+  start_tracing(processor);
+  return 0;
+}
+
+static void write_escaped(FILE *out, const char *text, int length) {
+  int i;
+
+  for (i = 0; i < length; i++) {
+    unsigned char c = text[i];
+
+    if (c == '\n') {
+      fputs("\\n", out);
+    } else if (c == '\t') {
+      fputs("\\t", out);
+    } else if (c == '\\') {
+      fputs("\\\\", out);
+    } else if (c < 0x20 || c >= 0x7f) {
+      fprintf(out, "\\x%02x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+}
+
+/* Prints one line of the delta trace:
+ *   pc: disasm[  xN=value][  mem[addr]=value][  halt][  > output]
+ * "halt" marks an instruction that ended the simulation before it
+ * completed, and the console output is escaped to fit on the line.
+ * Registers changed by instructions a TraceFilter left out follow as
+ *   sync  xN=value
+ * lines before the next traced instruction. */
+static void write_delta_line(const TraceRecord *record) {
+  if (record->flags & TRACE_SYNC) {
+    fprintf(delta_file, "sync  x%d=%08x\n", record->rd, record->rd_value);
+    delta_R[record->rd] = record->rd_value;
+    return;
+  }
+
+  int length;
+  const char *line = disassembly_line(record->pc, record->insn, &length);
+
+  fwrite(line, 1, length - (line[length - 1] == '\n'), delta_file);
+
+  if ((record->flags & TRACE_REG_WRITE) &&
+      delta_R[record->rd] != record->rd_value) {
+    fprintf(delta_file, "  x%d=%08x", record->rd, record->rd_value);
+    delta_R[record->rd] = record->rd_value;
+  }
+  if (record->flags & TRACE_MEM_WRITE) {
+    fprintf(delta_file, "  mem[%08x]=%0*x", record->mem_addr,
+            2 * record->width, record->mem_value);
+  }
+  if (record->flags & TRACE_HALT) {
+    fputs("  halt", delta_file);
+  }
+  if (delta_output_length > 0) {
+    fputs("  > ", delta_file);
+    write_escaped(delta_file, delta_output, delta_output_length);
+    delta_output_length = 0;
+  }
+  fputc('\n', delta_file);
+}
+
+static void delta_console(const TraceRecord *record) {
+  if (delta_output_length + record->width > delta_output_size) {
+    delta_output_size = 2 * (delta_output_length + record->width);
+    delta_output = realloc(delta_output, delta_output_size);
+  }
+  memcpy(delta_output + delta_output_length, record->text, record->width);
+  delta_output_length += record->width;
+}
+
+/* Hands a finished record to every open trace. */
+static void emit(const TraceRecord *record) {
+  if (trace_file != NULL && !(record->flags & (TRACE_HALT | TRACE_UNTRACED))) {
+    fwrite(record, sizeof(*record), 1, trace_file);
+  }
+  if (delta_file != NULL && !(record->flags & TRACE_UNTRACED)) {
+    if (record->flags & TRACE_OUTPUT) {
+      delta_console(record);
+    } else {
+      write_delta_line(record);
+    }
+  }
+  if (text_file != NULL) {
+    trace_format_record(&text_format, record, text_file);
+  }
+}
+
+static void submit(const TraceRecord *record) {
+  if (ring.running) {
+    ring_push(record);
+  } else {
+    emit(record);
+  }
+}
+
+void trace_close(void) {
+  if (in_flight) {
+    current.flags |= TRACE_HALT;
+    submit(&current);
+    in_flight = 0;
+  }
+  stop_async();
+
+  if (memory_trace) {
+    memtrace_close();
+    memory_trace = 0;
+  }
+  if (delta_file != NULL) {
+    fclose(delta_file);
+    delta_file = NULL;
+  }
+  if (trace_file != NULL) {
+    fclose(trace_file);
+    trace_file = NULL;
+  }
+  if (text_file != NULL) {
+    fflush(text_file);
+    text_file = NULL;
+  }
+  trace_active = 0;
+  console_hook = NULL;
+}
+
+void trace_begin(Word pc, Word instruction_bits) {
+  memset(&current, 0, sizeof(current));
+  current.pc = pc;
+  current.insn = instruction_bits;
+  in_flight = 1;
+  if (memory_trace) {
+    memtrace_fetch(pc, instruction_bits);
+  }
+}
+
+/* Completes the record of the instruction started by trace_begin() once it
+ * has executed; processor holds the post-execution state. */
+void trace_end(const Processor *processor) {
+  Instruction instruction = {.bits = current.insn};
+
+  switch (instruction.opcode) {
+  case 0x73:
+    /* of the system instructions only the CSR reads write rd */
+    if (instruction.rtype.funct3 == 0) {
+      break;
+    }
+    /* fall through */
+  case 0x33:
+  case 0x13:
+  case 0x03:
+  case 0x37:
+  case 0x6F:
+    if (instruction.rtype.rd != 0) {
+      current.flags |= TRACE_REG_WRITE;
+      current.rd = instruction.rtype.rd;
+      current.rd_value = processor->R[instruction.rtype.rd];
+      traced_R[current.rd] = current.rd_value;
+    }
+    break;
+  }
+  /* nothing to hand over if only the memory trace is open */
+  if (trace_file != NULL || delta_file != NULL || text_file != NULL) {
+    submit(&current);
+  }
+  in_flight = 0;
+}
+
+void trace_mem_access(Address address, Alignment alignment, Word value,
+                      int is_write) {
+  /* an instruction left out by the filter has no record to add to */
+  if (!in_flight) {
+    return;
+  }
+  current.flags |= is_write ? TRACE_MEM_WRITE : TRACE_MEM_READ;
+  current.width = alignment;
+  current.mem_addr = address;
+  if (is_write && alignment != LENGTH_WORD) {
+    value &= (1U << (8 * alignment)) - 1;
+  }
+  current.mem_value = value;
+  if (memory_trace) {
+    memtrace_access(current.pc, address, alignment, value,
+                    is_write ? MEMTRACE_WRITE : MEMTRACE_READ);
+  }
+}
+
+/* Console output of an instruction (ecall output or an error message) is
+ * emitted ahead of the instruction's own record, split over as many
+ * TRACE_OUTPUT records as needed. If the instruction ends the simulation
+ * its own record never follows. */
+void trace_console(const char *text, int length) {
+  TraceRecord record;
+
+  while (length > 0) {
+    int chunk = length < TRACE_TEXT_BYTES ? length : TRACE_TEXT_BYTES;
+
+    memset(&record, 0, sizeof(record));
+    record.pc = current.pc;
+    record.insn = current.insn;
+    record.flags = TRACE_OUTPUT;
+    record.width = chunk;
+    memcpy(record.text, text, chunk);
+    submit(&record);
+
+    text += chunk;
+    length -= chunk;
+  }
+}
+
+/* The console_hook while tracing. Once the text trace owns stdout the
+ * output must only reach it through the records. */
+static int console_to_trace(const char *text, int length) {
+  TraceRecord record;
+
+  if (in_flight) {
+    trace_console(text, length);
+    return text_file != NULL;
+  }
+  if (text_file == NULL) {
+    return 0;
+  }
+  /* output of an instruction left out by the filter still goes to stdout */
+  while (length > 0) {
+    int chunk = length < TRACE_TEXT_BYTES ? length : TRACE_TEXT_BYTES;
+
+    memset(&record, 0, sizeof(record));
+    record.flags = TRACE_OUTPUT | TRACE_UNTRACED;
+    record.width = chunk;
+    memcpy(record.text, text, chunk);
+    submit(&record);
+
+    text += chunk;
+    length -= chunk;
+  }
+  return 1;
+}
+
+/* ---- filtering ---- */
+
+int trace_filtering = 0;
+
+static TraceFilter filter;
+static Double filter_executed, filter_traced;
+static int filter_started, filter_tracing;
+
+void trace_filter_init(TraceFilter *filter) {
+  memset(filter, 0, sizeof(*filter));
+  filter->to = UINT64_MAX;
+  filter->count = UINT64_MAX;
+  filter->pc_hi = UINT32_MAX;
+  filter->start_reg = -1;
+}
+
+void trace_set_filter(const TraceFilter *new_filter) {
+  filter = *new_filter;
+  filter_started = !filter.start_on_pc && filter.start_reg < 0;
+  trace_filtering = 1;
+}
+
+/* Brings the traces up to date with the registers changed by instructions
+ * that were left out. */
+static void trace_sync(const Processor *processor) {
+  TraceRecord record;
+  int i;
+
+  for (i = 1; i < 32; i++) {
+    if (traced_R[i] == processor->R[i]) {
+      continue;
+    }
+    memset(&record, 0, sizeof(record));
+    record.pc = processor->PC;
+    record.flags = TRACE_REG_WRITE | TRACE_SYNC;
+    record.rd = i;
+    record.rd_value = processor->R[i];
+    submit(&record);
+    traced_R[i] = processor->R[i];
+  }
+}
+
+int trace_filter_check(const Processor *processor) {
+  Double n = filter_executed++;
+  Word pc = processor->PC;
+  int traced;
+
+  if (!filter_started) {
+    filter_started =
+        (filter.start_on_pc && pc == filter.start_pc) ||
+        (filter.start_reg >= 0 &&
+         processor->R[filter.start_reg] == filter.start_value);
+  }
+  traced = filter_started && n >= filter.from && n < filter.to &&
+           pc >= filter.pc_lo && pc <= filter.pc_hi &&
+           filter_traced < filter.count;
+  if (traced) {
+    filter_traced++;
+    if (!filter_tracing && trace_active) {
+      trace_sync(processor);
+    }
+  }
+  filter_tracing = traced;
+  return traced;
+}
+
+/* ---- text formatting ---- */
+
+void trace_format_init(TraceFormatter *format, const Register *R,
+                       int regdump, int disasm) {
+  memset(format, 0, sizeof(*format));
+  memcpy(format->R, R, sizeof(format->R));
+  format->regdump = regdump;
+  format->disasm = disasm;
+}
+
+/* Prints what `riscv -r -t` prints for record. The disassembly line of an
+ * instruction with console output is printed ahead of that output, so
+ * remember which pc it was printed for. */
+void trace_format_record(TraceFormatter *format, const TraceRecord *record,
+                         FILE *out) {
+  if (record->flags & TRACE_SYNC) {
+    format->R[record->rd] = record->rd_value;
+    return;
+  }
+  if (record->flags & TRACE_UNTRACED) {
+    fwrite(record->text, 1, record->width, out);
+    return;
+  }
+  if (format->disasm &&
+      !(format->line_printed && format->line_pc == record->pc)) {
+    int length;
+    const char *line = disassembly_line(record->pc, record->insn, &length);
+
+    fwrite(line, 1, length, out);
+  }
+
+  if (record->flags & (TRACE_OUTPUT | TRACE_HALT)) {
+    if (record->flags & TRACE_OUTPUT) {
+      fwrite(record->text, 1, record->width, out);
+    }
+    format->line_printed = 1;
+    format->line_pc = record->pc;
+    return;
+  }
+  format->line_printed = 0;
+
+  if (record->flags & TRACE_REG_WRITE) {
+    format->R[record->rd] = record->rd_value;
+  }
+  format->R[0] = 0;
+
+  if (format->regdump) {
+    print_registers(out, format->R);
+  }
+}
+
+/* Prints the dump as "r%2d=%08x " four to a line and a blank line. It is
+ * printed after every instruction with -r, so it is formatted by hand into
+ * one buffer rather than with 32 fprintf() calls. */
+void print_registers(FILE *out, const Register *R) {
+  static const char hex[] = "0123456789abcdef";
+  char dump[8 * (4 * 13 + 1) + 1], *p = dump;
+  int i, k;
+
+  for (i = 0; i < 32; i++) {
+    *p++ = 'r';
+    *p++ = i < 10 ? ' ' : '0' + i / 10;
+    *p++ = '0' + i % 10;
+    *p++ = '=';
+    for (k = 28; k >= 0; k -= 4) {
+      *p++ = hex[(R[i] >> k) & 0xf];
+    }
+    *p++ = ' ';
+    if (i % 4 == 3) {
+      *p++ = '\n';
+    }
+  }
+  *p++ = '\n';
+  fwrite(dump, 1, p - dump, out);
+}
+
+/* Reads one line of the dump, "r 0=00000000 r 1=...", into R. */
+int parse_register_line(const char *line, Register *R) {
+  int count = 0;
+
+  while ((line = strchr(line, 'r')) != NULL) {
+    char *end;
+    long index = strtol(line + 1, &end, 10);
+
+    if (*end != '=' || index < 0 || index > 31) {
+      return -1;
+    }
+    R[index] = strtoul(end + 1, &end, 16);
+    line = end;
+    count++;
+  }
+  return count == 4 ? 0 : -1;
+}
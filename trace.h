@@ -0,0 +1,129 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include "types.h"
+
+/* Delta traces are text: the full register dump of the initial state
+   followed by one line per instruction with only the values it changed,
+   see write_delta_line() in trace.c. */
+
+/* Binary trace files start with a TraceHeader followed by a stream of
+   fixed-size TraceRecords, one per executed instruction. Everything is
+   written in host (little-endian) byte order. */
+#define TRACE_MAGIC "RVTB"
+#define TRACE_VERSION 1
+
+/* TraceRecord.flags */
+#define TRACE_REG_WRITE 0x1 /* rd/rd_value are valid */
+#define TRACE_MEM_READ 0x2  /* mem_addr/mem_value hold a load */
+#define TRACE_MEM_WRITE 0x4 /* mem_addr/mem_value hold a store */
+#define TRACE_OUTPUT 0x8    /* console output of the ecall at pc, see text */
+/* the instruction at pc ended the simulation before completing; only passed
+ * to the sinks, never written to a binary trace */
+#define TRACE_HALT 0x10
+/* rd/rd_value give the register file at pc after instructions left out by a
+   TraceFilter; there is no instruction, insn is 0 */
+#define TRACE_SYNC 0x20
+/* console output of an instruction left out by a TraceFilter; only passed
+   to the sinks, never written to a binary trace */
+#define TRACE_UNTRACED 0x40
+
+#define TRACE_TEXT_BYTES 12
+
+typedef struct {
+    char magic[4];
+    Half version;
+    Half record_size;
+    Register R[32]; /* register file before the first instruction */
+    Register PC;
+} TraceHeader;
+
+typedef struct {
+    Word pc;
+    Word insn;
+    Byte rd;
+    Byte flags;
+    Byte width; /* access width in bytes, or text length for TRACE_OUTPUT */
+    Byte reserved;
+    union {
+        struct {
+            Word rd_value;
+            Word mem_addr;
+            Word mem_value;
+        };
+        char text[TRACE_TEXT_BYTES];
+    };
+} TraceRecord;
+
+/* set while a trace is being written, see execute() in riscv.c */
+extern int trace_active;
+
+/* codec is one of the TRACE_CODEC_* values in tracestream.h */
+int trace_open_binary(const char *filename, const Processor *processor,
+                      int codec);
+int trace_open_delta(const char *filename, const Processor *processor,
+                     int codec);
+void trace_close(void);
+void trace_begin(Word pc, Word instruction_bits);
+void trace_end(const Processor *processor);
+void trace_mem_access(Address address, Alignment alignment, Word value,
+                      int is_write);
+void trace_console(const char *text, int length);
+
+/* Writes the loads and stores, plus the instruction fetches if fetches is
+   set, to a memory-access trace; see memtrace.h. */
+int trace_open_memory(const char *filename, const Processor *processor,
+                      int codec, int fetches);
+
+/* Prints the text trace of `riscv -r -t` to out from the records rather
+   than from execute(); regdump and disasm select -r and -t. */
+int trace_open_text(FILE *out, const Processor *processor, int regdump,
+                    int disasm);
+
+/* Moves formatting and writing of the traces to a writer thread, fed
+   through a lock-free ring; see trace.c. The ring's occupancy and stall
+   counts are printed to stats, if not NULL, when the trace is closed. */
+int trace_start_async(FILE *stats);
+
+/* Selects the instructions printed by -r/-t and written to the traces.
+   Nothing is traced until the start trigger, if any, fires: the pc reaching
+   start_pc, or R[start_reg] holding start_value before an instruction. */
+typedef struct {
+    Double from, to;   /* instruction numbers from <= n < to, counting from 0 */
+    Double count;      /* stop after this many traced instructions */
+    Word pc_lo, pc_hi; /* only instructions at pc_lo <= pc <= pc_hi */
+    int start_on_pc;
+    Word start_pc;
+    int start_reg;     /* -1 for none */
+    Word start_value;
+} TraceFilter;
+
+/* set when a filter is installed, see execute() in riscv.c */
+extern int trace_filtering;
+
+/* fills filter with values that let everything through */
+void trace_filter_init(TraceFilter *filter);
+void trace_set_filter(const TraceFilter *filter);
+/* Called before every instruction while filtering; returns whether it is
+   to be traced. */
+int trace_filter_check(const Processor *processor);
+
+/* Turns a stream of records back into the -r/-t text format. */
+typedef struct {
+    Register R[32];
+    int regdump, disasm;
+    int line_printed; /* the disassembly of line_pc is already out */
+    Word line_pc;
+} TraceFormatter;
+
+void trace_format_init(TraceFormatter *format, const Register *R,
+                       int regdump, int disasm);
+void trace_format_record(TraceFormatter *format, const TraceRecord *record,
+                         FILE *out);
+
+/* the register dump printed by -r, and one line of it read back */
+void print_registers(FILE *out, const Register *R);
+int parse_register_line(const char *line, Register *R);
+
+#endif
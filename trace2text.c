@@ -0,0 +1,212 @@
+#include "riscv.h"
+#include "memtrace.h"
+#include "trace.h"
+#include "tracestream.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Expands a binary trace written by `riscv --trace-bin` or a delta trace
+ * written by `riscv --trace-delta`, compressed or not, into the text format
+ * printed by `riscv -r -t`, so it can be checked with compare.py or
+ * part2_tester.py against the files in code/ref. Memory-access traces
+ * written by `riscv --trace-mem` are printed one access per line. */
+
+int opt_regdump = 0, opt_disasm = 0;
+
+int convert_binary(FILE *file) {
+  TraceHeader header;
+
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, TRACE_MAGIC, 4) != 0 ||
+      header.version != TRACE_VERSION ||
+      header.record_size != sizeof(TraceRecord)) {
+    return -1;
+  }
+
+  TraceFormatter format;
+  TraceRecord record;
+
+  trace_format_init(&format, header.R, opt_regdump, opt_disasm);
+  while (fread(&record, sizeof(record), 1, file) == 1) {
+    trace_format_record(&format, &record, stdout);
+  }
+  return 0;
+}
+
+/* Prints "pc: R|W|F address/width value" per record. */
+int convert_memory(FILE *file) {
+  MemTraceHeader header;
+  MemTraceRecord record;
+
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, MEMTRACE_MAGIC, 4) != 0 ||
+      header.version != MEMTRACE_VERSION ||
+      header.record_size != sizeof(MemTraceRecord)) {
+    return -1;
+  }
+
+  while (fread(&record, sizeof(record), 1, file) == 1) {
+    printf("%08x: %c %08x/%d %0*x\n", record.pc, "RWF"[record.kind % 3],
+           record.addr, record.width, 2 * record.width, record.value);
+  }
+  return 0;
+}
+
+void write_unescaped(const char *text) {
+  for (; *text != '\0' && *text != '\n'; text++) {
+    if (*text != '\\') {
+      putchar(*text);
+      continue;
+    }
+    switch (*++text) {
+    case 'n':
+      putchar('\n');
+      break;
+    case 't':
+      putchar('\t');
+      break;
+    case 'x':
+      putchar((int)strtoul((char[]){text[1], text[2], '\0'}, NULL, 16));
+      text += 2;
+      break;
+    default:
+      putchar(*text);
+      break;
+    }
+  }
+}
+
+/* The delta format is described in write_delta_line() in trace.c. */
+int convert_delta(FILE *file) {
+  Register R[32];
+  char *line = NULL;
+  size_t size = 0;
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    if (getline(&line, &size, file) < 0 ||
+        parse_register_line(line, R) != 0) {
+      return -1;
+    }
+  }
+  if (getline(&line, &size, file) < 0) {
+    return 0;
+  }
+
+  while (getline(&line, &size, file) >= 0) {
+    char *end, *item;
+    int halted = 0, sync = strncmp(line, "sync", 4) == 0;
+
+    if (sync) {
+      item = line + 4;
+    } else {
+      Word pc = strtoul(line, &end, 16);
+
+      if (strncmp(end, ": ", 2) != 0) {
+        return -1;
+      }
+      char *disasm = end + 2;
+      item = strstr(disasm, "  ");
+      if (item == NULL) {
+        item = disasm + strcspn(disasm, "\n");
+      }
+
+      if (opt_disasm) {
+        printf("%08x: %.*s\n", pc, (int)(item - disasm), disasm);
+      }
+    }
+
+    while (strncmp(item, "  ", 2) == 0) {
+      item += 2;
+      if (item[0] == 'x') {
+        long rd = strtol(item + 1, &end, 10);
+
+        if (end == item + 1 || *end != '=' || rd < 0 || rd > 31) {
+          return -1;
+        }
+        R[rd] = strtoul(end + 1, &end, 16);
+      } else if (strncmp(item, "mem[", 4) == 0) {
+        end = item + strcspn(item, " \n");
+      } else if (strncmp(item, "halt", 4) == 0) {
+        halted = 1;
+        end = item + 4;
+      } else if (strncmp(item, "> ", 2) == 0) {
+        write_unescaped(item + 2);
+        break;
+      } else {
+        return -1;
+      }
+      item = end;
+    }
+    R[0] = 0;
+
+    if (opt_regdump && !halted && !sync) {
+      print_registers(stdout, R);
+    }
+  }
+  free(line);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int c;
+
+  while ((c = getopt(argc, argv, "rt")) != -1) {
+    switch (c) {
+    case 'r':
+      opt_regdump = 1;
+      break;
+    case 't':
+      opt_disasm = 1;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-r] [-t] trace\n", argv[0]);
+      return -1;
+    }
+  }
+
+  /* with neither flag print the full -r -t format */
+  if (!opt_regdump && !opt_disasm) {
+    opt_regdump = opt_disasm = 1;
+  }
+
+  if (argc <= optind) {
+    fprintf(stderr, "Give me a trace to convert!\n");
+    return -1;
+  }
+
+  FILE *file = trace_stream_open_read(argv[optind]);
+  if (file == NULL) {
+    fprintf(stderr, "Cannot open %s\n", argv[optind]);
+    return -1;
+  }
+
+  static char buffer[1 << 16];
+  setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+  /* binary traces start with their magic, delta traces with a dump */
+  char magic[4] = "";
+  int status;
+
+  if (fread(magic, 1, 4, file) != 4) {
+    memset(magic, 0, sizeof(magic));
+  }
+  rewind(file);
+
+  if (memcmp(magic, TRACE_MAGIC, 4) == 0) {
+    status = convert_binary(file);
+  } else if (memcmp(magic, MEMTRACE_MAGIC, 4) == 0) {
+    status = convert_memory(file);
+  } else {
+    status = convert_delta(file);
+  }
+  if (status != 0) {
+    fprintf(stderr, "%s is not a valid trace\n", argv[optind]);
+    return -1;
+  }
+
+  fclose(file);
+  return 0;
+}
@@ -0,0 +1,45 @@
+#include "compare.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Compares a trace printed by `riscv -r -t` (or a disassembly printed by
+ * `riscv -d`) against a reference and reports where they first diverge.
+ *
+ *   tracecmp actual expected     same verdict as compare.py: the files
+ *                                must match once all whitespace is removed
+ *   tracecmp -r actual expected  same verdict as part2_tester.py: the
+ *                                register dumps are compared one by one
+ *
+ * See compare.c. Exits 0 if they match, 1 if they do not. */
+
+int main(int argc, char **argv) {
+  int opt_registers = 0, c, result;
+  Double max_instructions = 10000;
+
+  while ((c = getopt(argc, argv, "rn:")) != -1) {
+    switch (c) {
+    case 'r':
+      opt_registers = 1;
+      break;
+    case 'n':
+      max_instructions = strtoull(optarg, NULL, 0);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-r [-n max]] actual expected\n", argv[0]);
+      return 2;
+    }
+  }
+  if (argc - optind != 2) {
+    fprintf(stderr, "usage: %s [-r [-n max]] actual expected\n", argv[0]);
+    return 2;
+  }
+
+  if (opt_registers) {
+    result = compare_register_files(argv[optind], argv[optind + 1],
+                                    max_instructions, stdout);
+  } else {
+    result = compare_text_files(argv[optind], argv[optind + 1], stdout);
+  }
+  return result < 0 ? 2 : result;
+}
@@ -0,0 +1,563 @@
+#define _GNU_SOURCE /* for fopencookie() */
+#include "tracestream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/* ---- built-in LZ codec ----
+ *
+ * An LZ77 byte format in the style of LZ4: a sequence of
+ *   token, [literal length bytes], literals, offset (2 bytes), [match length
+ *   bytes]
+ * where the token's high nibble is the literal count and its low nibble the
+ * match length minus LZ_MIN_MATCH; a nibble of 15 continues in following
+ * bytes that are summed until one is below 255. The last sequence carries
+ * literals only. Matches are found through a single-entry hash table, which
+ * is fast and does well on the repetitive records of a trace. */
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+
+static Word read32(const Byte *p) {
+  return (Word)p[0] | ((Word)p[1] << 8) | ((Word)p[2] << 16) |
+         ((Word)p[3] << 24);
+}
+
+static int lz_hash(Word sequence) {
+  return (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static Byte *lz_write_length(Byte *op, Byte *end, int length) {
+  while (length >= 255 && op < end) {
+    *op++ = 255;
+    length -= 255;
+  }
+  if (op < end) {
+    *op++ = length;
+  }
+  return op;
+}
+
+static Byte *lz_write_sequence(Byte *op, Byte *end, const Byte *literals,
+                               int literal_length, int offset,
+                               int match_length) {
+  int match_code = match_length - LZ_MIN_MATCH;
+  Byte *token = op++;
+
+  if (op > end) {
+    return NULL;
+  }
+  *token = (literal_length < 15 ? literal_length : 15) << 4;
+  if (literal_length >= 15) {
+    op = lz_write_length(op, end, literal_length - 15);
+  }
+  if (op + literal_length > end) {
+    return NULL;
+  }
+  memcpy(op, literals, literal_length);
+  op += literal_length;
+
+  if (offset == 0) {
+    return op;
+  }
+  if (op + 2 > end) {
+    return NULL;
+  }
+  *op++ = offset & 0xFF;
+  *op++ = offset >> 8;
+  *token |= match_code < 15 ? match_code : 15;
+  if (match_code >= 15) {
+    op = lz_write_length(op, end, match_code - 15);
+  }
+  return op < end ? op : NULL;
+}
+
+int lz_compress_bound(int in_size) { return in_size + in_size / 255 + 16; }
+
+/* Returns the compressed size, or -1 if it does not fit in out_size. */
+int lz_compress(const Byte *in, int in_size, Byte *out, int out_size) {
+  int table[1 << LZ_HASH_BITS];
+  Byte *op = out, *end = out + out_size;
+  int ip = 0, anchor = 0;
+
+  memset(table, 0, sizeof(table));
+  while (ip + LZ_MIN_MATCH <= in_size) {
+    Word sequence = read32(in + ip);
+    int h = lz_hash(sequence);
+    int ref = table[h] - 1;
+
+    table[h] = ip + 1;
+    if (ref < 0 || ip - ref > LZ_MAX_OFFSET || read32(in + ref) != sequence) {
+      ip++;
+      continue;
+    }
+
+    int length = LZ_MIN_MATCH;
+    while (ip + length < in_size && in[ref + length] == in[ip + length]) {
+      length++;
+    }
+    op = lz_write_sequence(op, end, in + anchor, ip - anchor, ip - ref,
+                           length);
+    if (op == NULL) {
+      return -1;
+    }
+    ip += length;
+    anchor = ip;
+  }
+
+  op = lz_write_sequence(op, end, in + anchor, in_size - anchor, 0, 0);
+  return op == NULL ? -1 : op - out;
+}
+
+static const Byte *lz_read_length(const Byte *ip, const Byte *end,
+                                  int *length) {
+  Byte b;
+
+  do {
+    if (ip >= end) {
+      return NULL;
+    }
+    b = *ip++;
+    *length += b;
+  } while (b == 255);
+  return ip;
+}
+
+/* Returns the decompressed size, or -1 if the input is malformed or does
+ * not fit in out_size. */
+int lz_decompress(const Byte *in, int in_size, Byte *out, int out_size) {
+  const Byte *ip = in, *end = in + in_size;
+  Byte *op = out;
+
+  while (ip < end) {
+    Byte token = *ip++;
+    int literal_length = token >> 4;
+    int match_length = (token & 0xF) + LZ_MIN_MATCH;
+
+    if (literal_length == 15 &&
+        (ip = lz_read_length(ip, end, &literal_length)) == NULL) {
+      return -1;
+    }
+    if (ip + literal_length > end || op + literal_length > out + out_size) {
+      return -1;
+    }
+    memcpy(op, ip, literal_length);
+    op += literal_length;
+    ip += literal_length;
+
+    if (ip == end) {
+      break;
+    }
+    if (ip + 2 > end) {
+      return -1;
+    }
+    int offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if ((token & 0xF) == 15 &&
+        (ip = lz_read_length(ip, end, &match_length)) == NULL) {
+      return -1;
+    }
+    if (offset == 0 || offset > op - out ||
+        op + match_length > out + out_size) {
+      return -1;
+    }
+    /* byte by byte, the match may overlap what it produces */
+    const Byte *match = op - offset;
+    while (match_length-- > 0) {
+      *op++ = *match++;
+    }
+  }
+  return op - out;
+}
+
+/* ---- codecs ---- */
+
+int trace_default_codec(void) {
+#ifdef HAVE_ZLIB
+  return TRACE_CODEC_ZLIB;
+#else
+  return TRACE_CODEC_LZ;
+#endif
+}
+
+int trace_codec_by_name(const char *name) {
+  if (name == NULL) {
+    return trace_default_codec();
+  } else if (strcmp(name, "lz") == 0) {
+    return TRACE_CODEC_LZ;
+  } else if (strcmp(name, "none") == 0) {
+    return TRACE_CODEC_NONE;
+#ifdef HAVE_ZLIB
+  } else if (strcmp(name, "zlib") == 0) {
+    return TRACE_CODEC_ZLIB;
+#endif
+  }
+  return -1;
+}
+
+/* Returns the packed size, or -1 if the block does not compress. */
+static int compress_block(int codec, const Byte *in, int in_size, Byte *out,
+                          int out_size) {
+  switch (codec) {
+  case TRACE_CODEC_LZ:
+    return lz_compress(in, in_size, out, out_size);
+#ifdef HAVE_ZLIB
+  case TRACE_CODEC_ZLIB: {
+    uLongf packed_size = out_size;
+    if (compress2(out, &packed_size, in, in_size, Z_BEST_SPEED) != Z_OK) {
+      return -1;
+    }
+    return packed_size;
+  }
+#endif
+  }
+  return -1;
+}
+
+static int decompress_block(int codec, const Byte *in, int in_size, Byte *out,
+                            int out_size) {
+  switch (codec) {
+  case TRACE_CODEC_NONE:
+    if (in_size > out_size) {
+      return -1;
+    }
+    memcpy(out, in, in_size);
+    return in_size;
+  case TRACE_CODEC_LZ:
+    return lz_decompress(in, in_size, out, out_size);
+#ifdef HAVE_ZLIB
+  case TRACE_CODEC_ZLIB: {
+    uLongf raw_size = out_size;
+    if (uncompress(out, &raw_size, in, in_size) != Z_OK) {
+      return -1;
+    }
+    return raw_size;
+  }
+#endif
+  }
+  return -1;
+}
+
+/* ---- streams ---- */
+
+typedef struct {
+  FILE *file;
+  int codec;
+  Byte *raw;    /* the current block, uncompressed */
+  int raw_size; /* bytes in raw */
+  int raw_pos;  /* read position in raw */
+  Byte *packed;
+  int packed_capacity;
+  Double raw_offset; /* of raw[0] in the raw stream */
+  TraceBlockIndex *index;
+  int blocks, index_capacity;
+  int next_block; /* index of the block following raw when reading */
+} TraceStream;
+
+static void add_block(TraceStream *stream, Double file_offset,
+                      Double raw_offset) {
+  if (stream->blocks == stream->index_capacity) {
+    stream->index_capacity =
+        stream->index_capacity ? 2 * stream->index_capacity : 64;
+    stream->index = realloc(stream->index,
+                            stream->index_capacity * sizeof(TraceBlockIndex));
+  }
+  stream->index[stream->blocks].file_offset = file_offset;
+  stream->index[stream->blocks].raw_offset = raw_offset;
+  stream->blocks++;
+}
+
+static void free_stream(TraceStream *stream) {
+  fclose(stream->file);
+  free(stream->raw);
+  free(stream->packed);
+  free(stream->index);
+  free(stream);
+}
+
+static int flush_block(TraceStream *stream) {
+  TraceBlockHeader header;
+  const Byte *payload = stream->packed;
+  int packed_size;
+
+  if (stream->raw_size == 0) {
+    return 0;
+  }
+  packed_size = compress_block(stream->codec, stream->raw, stream->raw_size,
+                               stream->packed, stream->packed_capacity);
+
+  memset(&header, 0, sizeof(header));
+  header.raw_size = stream->raw_size;
+  if (packed_size < 0 || packed_size >= stream->raw_size) {
+    header.codec = TRACE_CODEC_NONE;
+    header.packed_size = stream->raw_size;
+    payload = stream->raw;
+  } else {
+    header.codec = stream->codec;
+    header.packed_size = packed_size;
+  }
+
+  add_block(stream, ftell(stream->file), stream->raw_offset);
+  if (fwrite(&header, sizeof(header), 1, stream->file) != 1 ||
+      fwrite(payload, 1, header.packed_size, stream->file) !=
+          header.packed_size) {
+    return -1;
+  }
+  stream->raw_offset += stream->raw_size;
+  stream->raw_size = 0;
+  return 0;
+}
+
+static ssize_t stream_write(void *cookie, const char *data, size_t size) {
+  TraceStream *stream = cookie;
+  size_t written = 0;
+
+  while (written < size) {
+    size_t chunk = TRACE_STREAM_BLOCK_SIZE - stream->raw_size;
+    if (chunk > size - written) {
+      chunk = size - written;
+    }
+    memcpy(stream->raw + stream->raw_size, data + written, chunk);
+    stream->raw_size += chunk;
+    written += chunk;
+    if (stream->raw_size == TRACE_STREAM_BLOCK_SIZE &&
+        flush_block(stream) != 0) {
+      return -1;
+    }
+  }
+  return written;
+}
+
+static int stream_close_write(void *cookie) {
+  TraceStream *stream = cookie;
+  TraceBlockHeader header;
+  TraceStreamTrailer trailer;
+  int result = flush_block(stream);
+
+  memset(&header, 0, sizeof(header));
+  header.codec = TRACE_CODEC_INDEX;
+  header.packed_size = stream->blocks * sizeof(TraceBlockIndex);
+  memset(&trailer, 0, sizeof(trailer));
+  trailer.index_offset = ftell(stream->file);
+  memcpy(trailer.magic, TRACE_STREAM_MAGIC, 4);
+
+  fwrite(&header, sizeof(header), 1, stream->file);
+  fwrite(stream->index, sizeof(TraceBlockIndex), stream->blocks, stream->file);
+  fwrite(&trailer, sizeof(trailer), 1, stream->file);
+  if (ferror(stream->file)) {
+    result = -1;
+  }
+  free_stream(stream);
+  return result;
+}
+
+FILE *trace_stream_open_write(const char *filename, int codec) {
+  TraceStreamHeader header;
+  cookie_io_functions_t functions = {NULL, stream_write, NULL,
+                                     stream_close_write};
+  TraceStream *stream;
+  FILE *file = fopen(filename, "wb");
+
+  if (file == NULL || codec == TRACE_CODEC_NONE) {
+    return file;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_STREAM_MAGIC, 4);
+  header.version = TRACE_STREAM_VERSION;
+  header.block_size = TRACE_STREAM_BLOCK_SIZE;
+  fwrite(&header, sizeof(header), 1, file);
+
+  stream = calloc(1, sizeof(TraceStream));
+  stream->file = file;
+  stream->codec = codec;
+  stream->raw = malloc(TRACE_STREAM_BLOCK_SIZE);
+  stream->packed_capacity = lz_compress_bound(TRACE_STREAM_BLOCK_SIZE) + 1024;
+  stream->packed = malloc(stream->packed_capacity);
+  return fopencookie(stream, "w", functions);
+}
+
+/* Decompresses block number block into stream->raw. */
+static int load_block(TraceStream *stream, int block) {
+  TraceBlockHeader header;
+
+  stream->raw_size = stream->raw_pos = 0;
+  if (block >= stream->blocks) {
+    stream->next_block = stream->blocks;
+    return 0;
+  }
+  if (fseek(stream->file, stream->index[block].file_offset, SEEK_SET) != 0 ||
+      fread(&header, sizeof(header), 1, stream->file) != 1 ||
+      header.packed_size > (Word)stream->packed_capacity ||
+      fread(stream->packed, 1, header.packed_size, stream->file) !=
+          header.packed_size) {
+    return -1;
+  }
+  int raw_size = decompress_block(header.codec, stream->packed,
+                                  header.packed_size, stream->raw,
+                                  TRACE_STREAM_BLOCK_SIZE);
+  if (raw_size != (int)header.raw_size) {
+    return -1;
+  }
+  stream->raw_size = raw_size;
+  stream->raw_offset = stream->index[block].raw_offset;
+  stream->next_block = block + 1;
+  return 0;
+}
+
+static ssize_t stream_read(void *cookie, char *data, size_t size) {
+  TraceStream *stream = cookie;
+  size_t done = 0;
+
+  while (done < size) {
+    if (stream->raw_pos == stream->raw_size) {
+      if (stream->next_block >= stream->blocks) {
+        break;
+      }
+      if (load_block(stream, stream->next_block) != 0) {
+        return done > 0 ? (ssize_t)done : -1;
+      }
+      continue;
+    }
+    size_t chunk = stream->raw_size - stream->raw_pos;
+    if (chunk > size - done) {
+      chunk = size - done;
+    }
+    memcpy(data + done, stream->raw + stream->raw_pos, chunk);
+    stream->raw_pos += chunk;
+    done += chunk;
+  }
+  return done;
+}
+
+static Double stream_length(TraceStream *stream) {
+  TraceBlockIndex *last;
+  TraceBlockHeader header;
+
+  if (stream->blocks == 0) {
+    return 0;
+  }
+  last = &stream->index[stream->blocks - 1];
+  fseek(stream->file, last->file_offset, SEEK_SET);
+  if (fread(&header, sizeof(header), 1, stream->file) != 1) {
+    return last->raw_offset;
+  }
+  return last->raw_offset + header.raw_size;
+}
+
+static int stream_seek(void *cookie, off64_t *offset, int whence) {
+  TraceStream *stream = cookie;
+  Double target = *offset;
+  int low = 0, high = stream->blocks - 1;
+
+  if (whence == SEEK_CUR) {
+    target = stream->raw_offset + stream->raw_pos + *offset;
+  } else if (whence == SEEK_END) {
+    target = stream_length(stream) + *offset;
+  }
+
+  /* the last block starting at or before target */
+  while (low < high) {
+    int middle = (low + high + 1) / 2;
+    if (stream->index[middle].raw_offset <= target) {
+      low = middle;
+    } else {
+      high = middle - 1;
+    }
+  }
+  if (stream->blocks == 0) {
+    stream->raw_offset = stream->raw_size = stream->raw_pos = 0;
+    *offset = 0;
+    return target == 0 ? 0 : -1;
+  }
+  if (!(stream->next_block == low + 1 && stream->raw_offset ==
+                                             stream->index[low].raw_offset) &&
+      load_block(stream, low) != 0) {
+    return -1;
+  }
+  if (target > stream->raw_offset + stream->raw_size) {
+    return -1;
+  }
+  stream->raw_pos = target - stream->raw_offset;
+  *offset = target;
+  return 0;
+}
+
+static int stream_close_read(void *cookie) {
+  free_stream(cookie);
+  return 0;
+}
+
+/* Reads the block index from the trailer, or rebuilds it by walking the
+ * block headers if the stream was not closed properly. */
+static void read_index(TraceStream *stream) {
+  TraceStreamTrailer trailer;
+  TraceBlockHeader header;
+  long offset;
+
+  if (fseek(stream->file, -(long)sizeof(trailer), SEEK_END) == 0 &&
+      fread(&trailer, sizeof(trailer), 1, stream->file) == 1 &&
+      memcmp(trailer.magic, TRACE_STREAM_MAGIC, 4) == 0 &&
+      fseek(stream->file, trailer.index_offset, SEEK_SET) == 0 &&
+      fread(&header, sizeof(header), 1, stream->file) == 1 &&
+      header.codec == TRACE_CODEC_INDEX) {
+    int blocks = header.packed_size / sizeof(TraceBlockIndex);
+    stream->index = malloc(blocks * sizeof(TraceBlockIndex) + 1);
+    if (fread(stream->index, sizeof(TraceBlockIndex), blocks,
+              stream->file) == (size_t)blocks) {
+      stream->blocks = stream->index_capacity = blocks;
+      return;
+    }
+    free(stream->index);
+    stream->index = NULL;
+  }
+
+  fseek(stream->file, 0, SEEK_END);
+  long file_size = ftell(stream->file);
+  Double raw_offset = 0;
+
+  offset = sizeof(TraceStreamHeader);
+  fseek(stream->file, offset, SEEK_SET);
+  while (fread(&header, sizeof(header), 1, stream->file) == 1 &&
+         header.codec != TRACE_CODEC_INDEX) {
+    long end = offset + sizeof(header) + header.packed_size;
+    /* stop at a block cut short */
+    if (end > file_size || fseek(stream->file, end, SEEK_SET) != 0) {
+      break;
+    }
+    add_block(stream, offset, raw_offset);
+    raw_offset += header.raw_size;
+    offset = end;
+  }
+}
+
+FILE *trace_stream_open_read(const char *filename) {
+  TraceStreamHeader header;
+  cookie_io_functions_t functions = {stream_read, NULL, stream_seek,
+                                     stream_close_read};
+  TraceStream *stream;
+  FILE *file = fopen(filename, "rb");
+
+  if (file == NULL) {
+    return NULL;
+  }
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, TRACE_STREAM_MAGIC, 4) != 0 ||
+      header.version != TRACE_STREAM_VERSION ||
+      header.block_size > TRACE_STREAM_BLOCK_SIZE) {
+    rewind(file);
+    return file;
+  }
+
+  stream = calloc(1, sizeof(TraceStream));
+  stream->file = file;
+  stream->raw = malloc(TRACE_STREAM_BLOCK_SIZE);
+  stream->packed_capacity = lz_compress_bound(TRACE_STREAM_BLOCK_SIZE) + 1024;
+  stream->packed = malloc(stream->packed_capacity);
+  read_index(stream);
+  return fopencookie(stream, "r", functions);
+}
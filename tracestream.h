@@ -0,0 +1,66 @@
+#ifndef TRACESTREAM_H
+#define TRACESTREAM_H
+
+#include <stdio.h>
+#include "types.h"
+
+/* Compressed trace files are a TraceStreamHeader followed by independently
+   compressed blocks, each introduced by a TraceBlockHeader, and end with an
+   index of the blocks so readers can seek without decompressing everything
+   before the target. A stream cut short (e.g. the simulator was killed) is
+   still readable up to its last complete block. */
+#define TRACE_STREAM_MAGIC "RVTZ"
+#define TRACE_STREAM_VERSION 1
+#define TRACE_STREAM_BLOCK_SIZE (256 * 1024)
+
+/* TraceBlockHeader.codec */
+#define TRACE_CODEC_NONE 0
+#define TRACE_CODEC_LZ 1
+#define TRACE_CODEC_ZLIB 2
+#define TRACE_CODEC_INDEX 0xFF /* the block index, always stored */
+
+typedef struct {
+    char magic[4];
+    Half version;
+    Half reserved;
+    Word block_size; /* largest raw_size of any block */
+} TraceStreamHeader;
+
+typedef struct {
+    Word raw_size;
+    Word packed_size;
+    Byte codec;
+    Byte reserved[3];
+} TraceBlockHeader;
+
+/* one entry of the index per data block */
+typedef struct {
+    Double file_offset; /* of the block's TraceBlockHeader */
+    Double raw_offset;  /* of the block's first byte in the raw stream */
+} TraceBlockIndex;
+
+/* the last bytes of a complete stream */
+typedef struct {
+    Double index_offset;
+    char magic[4];
+} TraceStreamTrailer;
+
+/* the best codec built in: zlib if available, otherwise TRACE_CODEC_LZ */
+int trace_default_codec(void);
+int trace_codec_by_name(const char *name);
+
+/* Returns a stdio stream that compresses what is written to it with codec
+   into filename, or a plain file for TRACE_CODEC_NONE. */
+FILE *trace_stream_open_write(const char *filename, int codec);
+
+/* Opens filename for reading, decompressing it transparently if it is a
+   compressed stream. fseek(SEEK_SET) on the result jumps straight to the
+   block holding the target offset. */
+FILE *trace_stream_open_read(const char *filename);
+
+/* the built-in LZ codec, see tracestream.c */
+int lz_compress(const Byte *in, int in_size, Byte *out, int out_size);
+int lz_decompress(const Byte *in, int in_size, Byte *out, int out_size);
+int lz_compress_bound(int in_size);
+
+#endif
@@ -1,7 +1,32 @@
 #include "utils.h"
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+/* Receives a copy of everything console_print() writes, so a binary trace
+ * can record the simulator's output alongside the instructions. A nonzero
+ * return means the hook has taken the output over and it is not printed. */
+int (*console_hook)(const char *text, int length) = NULL;
+
+/* Prints output the simulator produces on behalf of the guest program
+ * (ecalls and error messages) to stdout. */
+void console_print(const char *format, ...) {
+  char text[256];
+  va_list args;
+  int length;
+
+  va_start(args, format);
+  length = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (length > (int)sizeof(text) - 1) {
+    length = sizeof(text) - 1;
+  }
+
+  if (console_hook == NULL || !console_hook(text, length)) {
+    fwrite(text, 1, length, stdout);
+  }
+}
+
 /* Sign extends the given field to a 32-bit integer where field is
  * interpreted an n-bit integer. */
 int sign_extend_number(unsigned int field, unsigned int n) {
@@ -77,15 +102,28 @@ int get_store_offset(Instruction instruction) {
 }
 
 void handle_invalid_instruction(Instruction instruction) {
-  printf("Invalid Instruction: 0x%08x\n", instruction.bits);
+  console_print(INVALID_FORMAT, instruction.bits);
 }
 
 void handle_invalid_read(Address address) {
-  printf("Bad Read. Address: 0x%08x\n", address);
-  exit(-1);
+  console_print("Bad Read. Address: 0x%08x\n", address);
+  end_simulation(-1);
 }
 
 void handle_invalid_write(Address address) {
-  printf("Bad Write. Address: 0x%08x\n", address);
-  exit(-1);
+  console_print("Bad Write. Address: 0x%08x\n", address);
+  end_simulation(-1);
+}
+
+/* Called by end_simulation() instead of exit(), so a simulation can end
+ * without ending the process. It must not return; fuzz.c longjmp()s out
+ * of the instruction. */
+void (*exit_hook)(int status) = NULL;
+
+/* Ends the simulation with an exit status, on an ecall or an error. */
+void end_simulation(int status) {
+  if (exit_hook != NULL) {
+    exit_hook(status);
+  }
+  exit(status);
 }
@@ -7,12 +7,20 @@
 #define JAL_FORMAT "jal\tx%d, %d\n"
 #define BRANCH_FORMAT "%s\tx%d, x%d, %d\n"
 #define ECALL_FORMAT "ecall\n"
+#define CSR_FORMAT "%s\tx%d, %s, x%d\n"
+#define CSRI_FORMAT "%s\tx%d, %s, %d\n"
+#define COUNTER_FORMAT "%s\tx%d\n"
+#define INVALID_FORMAT "Invalid Instruction: 0x%08x\n"
 
 int sign_extend_number(unsigned, unsigned);
 Instruction parse_instruction(uint32_t);
 int get_branch_offset(Instruction);
 int get_jump_offset(Instruction);
 int get_store_offset(Instruction);
+void console_print(const char *, ...);
+extern int (*console_hook)(const char *, int);
 void handle_invalid_instruction(Instruction);
 void handle_invalid_read(Address);
 void handle_invalid_write(Address);
+void end_simulation(int);
+extern void (*exit_hook)(int);